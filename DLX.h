@@ -1,56 +1,380 @@
 #ifndef DLX_H
 #define DLX_H
 
-#include <set>
+#include <map>
+#include <string>
+#include <sstream>
 #include <vector>
 #include <chrono>
 #include <iostream>
-#include <stack>
 #include <cmath>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <random>
 
 /*
  * These classes implement Donald Knuth's Algorithm X with dancing links and applies it to three
  * different problems: sudoku, the n-queens problem, and polyomino tiling (a generalization of pentomino tiling). 
+ * The last class accepts any exact cover problem, with colors on its optional columns (Knuth's Algorithm C).
  */
 
 using namespace std;
 
-struct dlx_matrix_node;
-
-// Holds the info for each column header, with the column number, number of remaining 1's, and top and bottom pointers.
+// Holds the info for each column header, with the column number, number of remaining 1's, and the arena
+// indices of the top and bottom nodes (-1 when the column has no remaining nodes).
 struct dlx_header_node {
     int count;
     int matrix_column;
-    dlx_matrix_node* top;
-    dlx_matrix_node* bottom;
+    int top;
+    int bottom;
+};
+
+// Hold the links of a matrix node as 32-bit indices into the node arena, up, down, left, and right.
+// The header (matrix column) and row of each node are kept in separate arrays alongside the arena, which keeps
+// a node at 16 bytes so that nodes never straddle a cache line.
+struct dlx_matrix_node {
+    int left;
+    int right;
+    int up;
+    int down;
+};
+
+// The kinds of moves made before a search which hold for the whole search:
+// Fixed row: the row of node was fixed into the solution by initialize.
+// Excluded column: column was removed along with every row covering it (node is then the row the column was
+//                  left linked to, or -1 if it had none).
+// Forced row: propagation found the row of node to be the only way left to satisfy column, and selected it
+//             onto the backtrack stack below the search.
+// Eliminated row: propagation found that the row of node cannot be in any solution and unlinked all of it.
+enum class dlx_fixed_move_type {
+    fixed_row,
+    excluded_column,
+    forced_row,
+    eliminated_row
+};
+
+// A move made while setting up a search, so that it can be undone when the search ends.
+struct dlx_fixed_move {
+    int column;
+    int node;
+    dlx_fixed_move_type type;
 };
 
-// Comparator for placing the header nodes into a set for doing the column selection heuristic.
-struct header_compare {
-    inline bool operator() (const dlx_header_node* l, const dlx_header_node* r) const {
-        return l->count < r->count || 
-            (l->matrix_column < r->matrix_column&&l->count==r->count); // keep the same order
+// Index of the column headers used for the column selection heuristic.
+// Headers are bucketed by their remaining count, and each bucket is a bitset over the matrix columns, so
+// changing a count is a constant time bit move with no allocation. The front of the index is the column with
+// the fewest remaining 1's, with ties broken by the lowest matrix column (the order the solver has always used).
+class dlx_column_index {
+public:
+    // Empties the index for the columns [first_column, last_column) whose counts never exceed max_count.
+    // Storage is only reallocated when it needs to grow, so a solver may reset it for every solve.
+    void reset(int first_column_in, int last_column_in, int max_count) {
+        first_column = first_column_in;
+        words_per_bucket = (max(last_column_in-first_column_in,0)+63)/64;
+        num_buckets = max_count+1;
+        bucket_bits.assign((size_t)num_buckets*words_per_bucket, 0);
+        bucket_size.assign(num_buckets, 0);
+        num_headers = 0;
+        min_count = num_buckets;
+    }
+    inline bool empty() const {
+        return num_headers==0;
+    }
+    inline int size() const {
+        return num_headers;
+    }
+    inline bool contains(const dlx_header_node* header) const {
+        int bit = header->matrix_column-first_column;
+        return (bucket_bits[(size_t)header->count*words_per_bucket+(bit>>6)]>>(bit&63))&1;
+    }
+    // Adds a header to the index, does nothing if it is already present.
+    inline void insert(dlx_header_node* header) {
+        if (!contains(header)) {
+            set_bit(header);
+            bucket_size[header->count]++;
+            num_headers++;
+            if (header->count<min_count) {
+                min_count = header->count;
+            }
+        }
+    }
+    // Removes a header from the index, does nothing if it is not present.
+    inline void erase(dlx_header_node* header) {
+        if (contains(header)) {
+            clear_bit(header);
+            bucket_size[header->count]--;
+            num_headers--;
+        }
+    }
+    // These change the count of a header, moving it to its new bucket if it is in the index.
+    inline void increment(dlx_header_node* header) {
+        if (contains(header)) {
+            clear_bit(header);
+            bucket_size[header->count]--;
+            header->count+=1;
+            set_bit(header);
+            bucket_size[header->count]++;
+        }
+        else {
+            header->count+=1;
+        }
+    }
+    inline void decrement(dlx_header_node* header) {
+        if (contains(header)) {
+            clear_bit(header);
+            bucket_size[header->count]--;
+            header->count-=1;
+            set_bit(header);
+            bucket_size[header->count]++;
+            if (header->count<min_count) {
+                min_count = header->count;
+            }
+        }
+        else {
+            header->count-=1;
+        }
+    }
+    // Returns the smallest count in the index. The index must not be empty.
+    inline int lowest_count() {
+        while (bucket_size[min_count]==0) {
+            min_count++;
+        }
+        return min_count;
+    }
+    // Returns the column with the smallest count in the index. The index must not be empty.
+    inline int front_column() {
+        const unsigned long long* bucket = &bucket_bits[(size_t)lowest_count()*words_per_bucket];
+        int word = 0;
+        while (bucket[word]==0) {
+            word++;
+        }
+        return first_column+word*64+__builtin_ctzll(bucket[word]);
     }
+    // Returns one of the columns with the smallest count in the index, chosen by the given random number.
+    // The index must not be empty.
+    inline int random_front_column(unsigned long long random) {
+        int count = lowest_count();
+        const unsigned long long* bucket = &bucket_bits[(size_t)count*words_per_bucket];
+        int skip = random%bucket_size[count];
+        int word = 0;
+        while (__builtin_popcountll(bucket[word])<=skip) {
+            skip -= __builtin_popcountll(bucket[word]);
+            word++;
+        }
+        unsigned long long bits = bucket[word];
+        for (; skip > 0; skip--) {
+            bits &= bits-1;
+        }
+        return first_column+word*64+__builtin_ctzll(bits);
+    }
+private:
+    inline void set_bit(const dlx_header_node* header) {
+        int bit = header->matrix_column-first_column;
+        bucket_bits[(size_t)header->count*words_per_bucket+(bit>>6)] |= 1ULL<<(bit&63);
+    }
+    inline void clear_bit(const dlx_header_node* header) {
+        int bit = header->matrix_column-first_column;
+        bucket_bits[(size_t)header->count*words_per_bucket+(bit>>6)] &= ~(1ULL<<(bit&63));
+    }
+    // One bitset of words_per_bucket words for each count from 0 to num_buckets-1.
+    vector<unsigned long long> bucket_bits;
+    vector<int> bucket_size;
+    int first_column = 0;
+    int words_per_bucket = 0;
+    int num_buckets = 0;
+    int num_headers = 0;
+    // Lower bound on the smallest non-empty bucket, raised lazily when the front is requested.
+    int min_count = 0;
 };
 
-// Hold the info for a matrix node, with pointers up, down, left, and right. Also a pointer to the header and the row.
-struct dlx_matrix_node {
-    dlx_matrix_node* left;
-    dlx_matrix_node* right;
-    dlx_matrix_node* up;
-    dlx_matrix_node* down;
-    dlx_header_node* header;
-    int matrix_row;
+// The result of dlx_matrix::verify_unique: the input has no solution, exactly one, or more than one.
+enum class dlx_uniqueness {
+    none,
+    unique,
+    multiple
+};
+
+// Limits on how long a search may run, which every entry point of dlx_matrix checks as it searches.
+struct dlx_search_limits {
+    // The search stops once this time is reached.
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::time_point::max();
+    // The search stops once it has tried this many rows, or never if -1. Parallel searches give each worker
+    // its own budget.
+    long long max_attempts = -1;
+    // The search stops once this is set, which may be done from another thread.
+    const atomic<bool>* cancel = NULL;
+};
+
+// How a randomized search restarts: never, after attempt budgets following the Luby sequence (1,1,2,1,1,2,4,...
+// times the base budget), or after budgets growing geometrically from the base budget.
+enum class dlx_restart_schedule {
+    none,
+    luby,
+    geometric
+};
+
+// Randomizes the order of a search, for inputs such as large sudokus where the fixed order can get stuck in a huge
+// subtree that a different order would avoid. With a seed, ties between the columns with the fewest rows are
+// broken at random and the rows of each column are tried starting from a random one, so that the seed picks one
+// of many equally valid search orders. Restarts only take effect with a seed: a run which has not found a
+// solution within its attempt budget is abandoned and the search begins again in a new random order. Once a
+// solution is found the search never restarts, and the budgets keep growing, so a search with restarts still
+// finds every solution exactly once and still finishes when there are none.
+struct dlx_search_randomization {
+    // Seed of the random order, or 0 for the fixed order.
+    unsigned long long seed = 0;
+    dlx_restart_schedule restarts = dlx_restart_schedule::none;
+    // Attempts allowed in the first run, which is also the unit of the Luby sequence. Values below 1 are taken as 1.
+    long long restart_base = 1000;
+    // Factor each geometric budget grows by. Values below min_restart_growth are taken as min_restart_growth, since
+    // budgets which stop growing may never be long enough to finish the search on an input with no solution.
+    double restart_growth = 1.5;
+    static constexpr double min_restart_growth = 1.1;
+};
+
+// Returns the i-th term (from 1) of the Luby sequence 1,1,2,1,1,2,4,1,1,2,1,1,2,4,8,...
+inline long long dlx_luby(long long i) {
+    int k = 1;
+    while ((1LL<<k)-1<i) {
+        k++;
+    }
+    if ((1LL<<k)-1==i) {
+        return 1LL<<(k-1);
+    }
+    return dlx_luby(i-(1LL<<(k-1))+1);
+}
+
+// What became of one board of a batch: it was solved, it is a valid sudoku with no solution, or it was rejected
+// (not a square of square width, a value out of range, or clues which conflict).
+enum class dlx_batch_outcome {
+    solved,
+    no_solution,
+    invalid
+};
+
+// How the last search ended: it ran to completion (or to the solution limit it was given), one of the search
+// limits stopped it early, or the input was rejected by initialize before any search.
+enum class dlx_search_status {
+    completed,
+    timed_out,
+    attempt_limit_reached,
+    cancelled,
+    invalid_input
 };
 
+// Returns the name of a search status, as used in the JSON statistics.
+inline const char* dlx_search_status_name(dlx_search_status status) {
+    switch (status) {
+        case dlx_search_status::completed:
+            return "completed";
+        case dlx_search_status::timed_out:
+            return "timed_out";
+        case dlx_search_status::attempt_limit_reached:
+            return "attempt_limit_reached";
+        case dlx_search_status::invalid_input:
+            return "invalid_input";
+        default:
+            return "cancelled";
+    }
+}
+
+// Statistics of the last search, which also tell a search stopped by its limits apart from one that ran out of
+// solutions. The counts cover the work done before the search stopped, and a parallel search adds up the counts
+// of its workers.
+struct dlx_search_stats {
+    dlx_search_status status = dlx_search_status::completed;
+    unsigned long long solutions = 0;
+    // Rows tried by the search, each of which is a node of the search tree.
+    long long attempts = 0;
+    // Times the search went back to an earlier choice to try its next row.
+    long long backtracks = 0;
+    // Times a randomized search was abandoned and begun again in a new order.
+    long long restarts = 0;
+    // States rejected by the problem's own check (see prune_state) while every mandatory column had rows left.
+    long long pruned = 0;
+    // Nodes unlinked from or linked back into their column.
+    long long link_updates = 0;
+    // The deepest the search got, in rows chosen.
+    int max_depth = 0;
+    // For each depth, the number of times the search chose a column there and the total number of rows those
+    // columns had left, so that depth_rows[i]/depth_choices[i] is the mean branching factor at depth i.
+    vector<long long> depth_choices;
+    vector<long long> depth_rows;
+    // Times in microseconds. Generation is done once when the solver is constructed, and search_us includes
+    // the time spent interpreting solutions.
+    double generation_us = 0;
+    double initialize_us = 0;
+    double search_us = 0;
+    double interpret_us = 0;
+    // Returns the statistics as a single JSON object.
+    string to_json() const {
+        ostringstream out;
+        out << "{\"status\":\"" << dlx_search_status_name(status) << "\""
+            << ",\"solutions\":" << solutions
+            << ",\"attempts\":" << attempts
+            << ",\"backtracks\":" << backtracks
+            << ",\"restarts\":" << restarts
+            << ",\"pruned\":" << pruned
+            << ",\"link_updates\":" << link_updates
+            << ",\"max_depth\":" << max_depth
+            << ",\"depth_choices\":" << json_array(depth_choices)
+            << ",\"depth_rows\":" << json_array(depth_rows)
+            << ",\"generation_us\":" << generation_us
+            << ",\"initialize_us\":" << initialize_us
+            << ",\"search_us\":" << search_us
+            << ",\"interpret_us\":" << interpret_us << "}";
+        return out.str();
+    }
+private:
+    static string json_array(const vector<long long> &values) {
+        ostringstream out;
+        out << "[";
+        for (int i = 0; i < values.size(); i++) {
+            out << (i>0?",":"") << values[i];
+        }
+        out << "]";
+        return out.str();
+    }
+};
+
+// Returns the number of bits needed to store values from 0 to num_values-1, which can be evaluated at compile time.
+constexpr int dlx_bits_for(int num_values, int bits=1) {
+    return ((1<<bits)>=num_values)?bits:dlx_bits_for(num_values,bits+1);
+}
+
+// Stores value as the index-th field of bits bits in packed, which must start out zeroed.
+inline void dlx_pack_bits(unsigned char* packed, int index, int bits, int value) {
+    for (int bit = 0; bit < bits; bit++) {
+        if (value>>bit&1) {
+            packed[(index*bits+bit)/8] |= 1<<(index*bits+bit)%8;
+        }
+    }
+}
+
+// Reads the index-th field of bits bits stored by dlx_pack_bits.
+inline int dlx_unpack_bits(const unsigned char* packed, int index, int bits) {
+    int value = 0;
+    for (int bit = 0; bit < bits; bit++) {
+        value |= (packed[(index*bits+bit)/8]>>(index*bits+bit)%8&1)<<bit;
+    }
+    return value;
+}
+
 // Generic templated class which can be used to create solvers for various exact cover problems.
 template <class input_format, class output_format>
 class dlx_matrix {
 public:
     // This enum allows the save setting of the solver to be set.
     // Solutions: save only solutions to the problem.
-    // Correct moves: save correct moves approaching the solution (possibly slow).
-    // All moves: save all moves made by the solver (very slow).
+    // Correct moves: save correct moves approaching the solution (a board for every row of every solution).
+    // All moves: save all moves made by the solver, starting with any rows forced by propagation (a board for every move,
+    // see trace to record them cheaply).
     // None: saves nothing, useful for enumerating the number of solutions
     //       to a problem as quickly as possible.
     enum class dlx_save_setting {
@@ -59,239 +383,1307 @@ public:
         all_moves,
         none
     };
-    // Restores a removed column by linking it back to nodes it is attached to and reinserting it to the set.
-    inline void restore_column(dlx_matrix_node* given_node, set<dlx_header_node*,header_compare> &header_tree, set<dlx_header_node*,header_compare> &optional_header_tree) {
-        for (dlx_matrix_node* curr_node = given_node->up; curr_node!=given_node; curr_node=curr_node->up) {// this loop visits all nodes remaining in a column EXCEPT the given one, downward
-            // this loop visits all nodes remaining in a row EXCEPT the one it shares with the column, rightward
-            for (dlx_matrix_node* curr_row_node = curr_node->left; curr_row_node!=curr_node; curr_row_node=curr_row_node->left) {
+    // Solvers are deleted through this class, for example by the parallel searches and new_dlx_matrix_sudoku's callers.
+    virtual ~dlx_matrix() {}
+    // Links a hidden node back into its column, at the position it was unlinked from.
+    inline void unhide_node(int curr_row_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        search_stats.link_updates++;
+        dlx_matrix_node* nodes = &matrix[0];
+        const dlx_matrix_node row_node = nodes[curr_row_node];
+        const int curr_column = node_header[curr_row_node];
+        dlx_header_node* curr_header = &matrix_header[curr_column];
 #ifdef DEBUG
-                if (curr_row_node->header->count < 0) {
-                    cout << "Negative count.\n";
-                    exit(1);
-                }
-                else {
+        if (curr_header->count < 0) {
+            cout << "Negative count.\n";
+            exit(1);
+        }
+        else {
 #endif
-                if (curr_row_node->header->count == 0) {
-                    curr_row_node->header->top = curr_row_node;
-                    curr_row_node->header->bottom = curr_row_node;
-                }
-                else {
-                    curr_row_node->up->down = curr_row_node;
-                    curr_row_node->down->up = curr_row_node;
-                    if (curr_row_node->matrix_row>curr_row_node->header->bottom->matrix_row/*&&curr_row_node->down==curr_row_node->header->top*/) {
-                        curr_row_node->header->bottom = curr_row_node;
-                    }
-                    else if (curr_row_node->matrix_row<curr_row_node->header->top->matrix_row/*&&curr_row_node->up==curr_row_node->header->bottom*/) {
-                        curr_row_node->header->top = curr_row_node;
-                    }
-                }
+        if (curr_header->count == 0) {
+            curr_header->top = curr_row_node;
+            curr_header->bottom = curr_row_node;
+        }
+        else {
+            nodes[row_node.up].down = curr_row_node;
+            nodes[row_node.down].up = curr_row_node;
+            // nodes are stored row by row, so comparing node indices compares matrix rows
+            if (curr_row_node>curr_header->bottom) {
+                curr_header->bottom = curr_row_node;
+            }
+            else if (curr_row_node<curr_header->top) {
+                curr_header->top = curr_row_node;
+            }
+        }
 #ifdef DEBUG
-                }
+        }
+#endif
+        
+        if (curr_column<optional_constraint_start_column) {
+            header_tree.increment(curr_header);
+        }
+        else {
+            optional_header_tree.increment(curr_header);
+        }
+    }
+    // Unlinks a node from its column, leaving the node's own links in place so that unhide_node can restore it.
+    inline void hide_node(int curr_row_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        search_stats.link_updates++;
+        dlx_matrix_node* nodes = &matrix[0];
+        // the node is copied since every field is an int which the count updates below could otherwise alias
+        const dlx_matrix_node row_node = nodes[curr_row_node];
+        const int curr_column = node_header[curr_row_node];
+        dlx_header_node* curr_header = &matrix_header[curr_column];
+        if (curr_column<optional_constraint_start_column) {
+            header_tree.decrement(curr_header);
+        }
+        else {
+            optional_header_tree.decrement(curr_header);
+        }
+#ifdef DEBUG
+        if (curr_header->top==-1||curr_header->bottom==-1) {
+            cout << "Null top and bottom nodes on header, count " << curr_header->count << endl;
+            exit(1);
+        }
+#endif
+        if (curr_header->count==0) {
+            curr_header->top = -1;
+            curr_header->bottom = -1;
+        }
+#ifdef DEBUG
+        else if (curr_header->count<0) {
+            cout << "Negative count in remove.\n";
+            exit(1);
+        }
 #endif
-                
-                //the safety checks on these are almost certainly unnecessary
-                //if (header_tree.erase(curr_row_node->header)>0) {
-                if (curr_row_node->header->matrix_column<optional_constraint_start_column) {
-                    header_tree.erase(curr_row_node->header);
-                    curr_row_node->header->count+=1;
-                    header_tree.insert(curr_row_node->header);
+        else {
+            if (curr_row_node==curr_header->top) {
+                curr_header->top = row_node.down;
+            }
+            else if (curr_row_node==curr_header->bottom) {
+                curr_header->bottom = row_node.up;
+            }
+            nodes[row_node.up].down = row_node.down;
+            nodes[row_node.down].up = row_node.up;
+        }
+    }
+    // Links a hidden row back into every column it has a node in, EXCEPT the column of the given node.
+    inline void unhide_row(int given_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        // this loop visits all nodes remaining in a row EXCEPT the given one, leftward
+        for (int curr_row_node = matrix[given_node].left; curr_row_node!=given_node; curr_row_node=matrix[curr_row_node].left) {
+            if (node_color.empty()||node_color[curr_row_node]>=0) {
+                unhide_node(curr_row_node, header_tree, optional_header_tree);
+            }
+        }
+    }
+    // Unlinks a row from every column it has a node in, EXCEPT the column of the given node.
+    // As in Knuth's hide', a node whose column has been purified to its color (marked by a negative color) is left
+    // in place: the column is never chosen or purified again while it is, so nothing visits the node, and it keeps
+    // its negative color until unhide_row, which skips it in turn.
+    inline void hide_row(int given_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        // this loop visits all nodes remaining in a row EXCEPT the given one, rightward
+        for (int curr_row_node = matrix[given_node].right; curr_row_node!=given_node; curr_row_node=matrix[curr_row_node].right) {
+            if (node_color.empty()||node_color[curr_row_node]>=0) {
+                hide_node(curr_row_node, header_tree, optional_header_tree);
+            }
+        }
+    }
+    // Restores a removed column by linking it back to nodes it is attached to and reinserting it to the set.
+    inline void restore_column(int given_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        for (int curr_node = matrix[given_node].up; curr_node!=given_node; curr_node=matrix[curr_node].up) {// this loop visits all nodes remaining in a column EXCEPT the given one, upward
+            unhide_row(curr_node, header_tree, optional_header_tree);
+        }
+    }
+    // Removes a column by unlinking its neighbors from it and removing it from the set.
+    inline void remove_column(int given_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        for (int curr_node = matrix[given_node].down; curr_node!=given_node; curr_node=matrix[curr_node].down) {// this loop visits all nodes remaining in a column EXCEPT the given one, downward
+            hide_row(curr_node, header_tree, optional_header_tree);
+        }
+    }
+    // Commits the optional column of the given node (of a row being selected) to the node's color: the column is
+    // left uncovered, but every other row which does not give it the same color is hidden, and the nodes of the
+    // rows which do are marked with the negated color so that selecting one of them later leaves the column alone.
+    inline void purify(int given_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        int color = node_color[given_node];
+        for (int curr_node = matrix[given_node].down; curr_node!=given_node; curr_node=matrix[curr_node].down) {
+            if (node_color[curr_node]==color) {
+                node_color[curr_node] = -color;
+            }
+            else {
+                hide_row(curr_node, header_tree, optional_header_tree);
+            }
+        }
+    }
+    // Undoes purify, visiting the column in the opposite order.
+    inline void unpurify(int given_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        int color = node_color[given_node];
+        for (int curr_node = matrix[given_node].up; curr_node!=given_node; curr_node=matrix[curr_node].up) {
+            if (node_color[curr_node]==-color) {
+                node_color[curr_node] = color;
+            }
+            else {
+                unhide_row(curr_node, header_tree, optional_header_tree);
+            }
+        }
+    }
+    // Restores a removed (previously selected) row by restoring all attached columns.
+    inline void restore_row(int given_row_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        // visits all columns except the one attached to the given node
+        for (int base_row_node = matrix[given_row_node].left; base_row_node!=given_row_node; base_row_node=matrix[base_row_node].left) {
+            if (!node_color.empty()&&node_color[base_row_node]!=0) {
+                if (node_color[base_row_node]>0) {
+                    unpurify(base_row_node, header_tree, optional_header_tree);
                 }
-                else {
-                    optional_header_tree.erase(curr_row_node->header);
-                    curr_row_node->header->count+=1;
-                    optional_header_tree.insert(curr_row_node->header);
+                continue;
+            }
+            if (!column_capacity.empty()&&column_capacity[node_header[base_row_node]]++>0) {
+                // the column was left uncovered by remove_row, which only hid this node from it
+                unhide_node(base_row_node, header_tree, optional_header_tree);
+                continue;
+            }
+            restore_column(base_row_node, header_tree, optional_header_tree);
+            if (node_header[base_row_node]<optional_constraint_start_column) {
+                header_tree.insert(&matrix_header[node_header[base_row_node]]);
+            }
+            else {
+                optional_header_tree.insert(&matrix_header[node_header[base_row_node]]);
+            }
+        }
+    }
+    // Removes a row by removing all attached columns.
+    inline void remove_row(int given_row_node, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        // visits all columns except the one attached to the given node
+        for (int base_row_node = matrix[given_row_node].right; base_row_node!=given_row_node; base_row_node=matrix[base_row_node].right) {
+            if (!node_color.empty()&&node_color[base_row_node]!=0) {
+                // a negative color means an earlier choice already committed the column to this row's color
+                if (node_color[base_row_node]>0) {
+                    purify(base_row_node, header_tree, optional_header_tree);
                 }
+                continue;
+            }
+            if (!column_capacity.empty()&&--column_capacity[node_header[base_row_node]]>0) {
+                // the column may still be covered by other rows, so only this row is taken out of it
+                hide_node(base_row_node, header_tree, optional_header_tree);
+                continue;
+            }
+            if (node_header[base_row_node]<optional_constraint_start_column) {
+                header_tree.erase(&matrix_header[node_header[base_row_node]]);
+            }
+            else {
+                optional_header_tree.erase(&matrix_header[node_header[base_row_node]]);
             }
+            remove_column(base_row_node, header_tree, optional_header_tree);
         }
     }
-    // Removes a column by unlinking its neighbors from it and removing it from the set.
-    inline void remove_column(dlx_matrix_node* given_node, set<dlx_header_node*,header_compare> &header_tree, set<dlx_header_node*,header_compare> &optional_header_tree) {
-        for (dlx_matrix_node* curr_node = given_node->down; curr_node!=given_node; curr_node=curr_node->down) {// this loop visits all nodes remaining in a column EXCEPT the given one, downward
-            // this loop visits all nodes remaining in a row EXCEPT the one it shares with the column, rightward
-            for (dlx_matrix_node* curr_row_node = curr_node->right; curr_row_node!=curr_node; curr_row_node=curr_row_node->right) {
-                //if (header_tree.erase(curr_row_node->header)>0) {
-                if (curr_row_node->header->matrix_column<optional_constraint_start_column) {
-                    header_tree.erase(curr_row_node->header);
-                    curr_row_node->header->count-=1;
-                    header_tree.insert(curr_row_node->header);
+    // This wrapper may be used to automatically fetch only the first solution to a problem (if one exists).
+    inline output_format solve(input_format data_in) {
+        return solve(data_in,1)[0];
+    }
+    // This function implements Knuth's Algorithm X with dancing links.
+    // The algorithm is complex, but essentially it just iterates over the exact cover matrix and 
+    // selects columns to satisfy, then iterates over the possible solutions.
+    // If it cannot find a solution, it undoes a choice and selects the next row. 
+    // If it runs out of choices to undo, there is no solution.
+    // If it runs out of columns to satisfy, a solution has been found.
+    // Finally, the number of solutions can be configured, and the problem states that get saved can also be configured.
+    // Statistics for the search are available from last_search afterwards.
+    vector<output_format> solve(input_format data_in, int max_solutions, dlx_save_setting save_setting=dlx_save_setting::solutions) {
+        int solution_count = 0;
+        vector<output_format> solutions;
+        if (save_setting == dlx_save_setting::correct_moves || save_setting == dlx_save_setting::all_moves) {
+            move_trace moves = trace(data_in, max_solutions, save_setting);
+            if (moves.solver==NULL) {
+                return vector<output_format>();
+            }
+            for (int i = 0; i < moves.size(); i++) {
+                solutions.push_back(moves.board(i));
+            }
+            solution_count = search_stats.solutions;
+        }
+        else {
+            if (max_solutions==-1) {
+                max_solutions = numeric_limits<int>::max();
+            }
+            if (!begin_search(data_in)) {
+                return vector<output_format>();
+            }
+            while (solution_count<max_solutions&&next_solution()) {
+                if (save_setting == dlx_save_setting::solutions) {
+                    solutions.push_back(interpret(backtrack_stack));
                 }
-                else {
-                    optional_header_tree.erase(curr_row_node->header);
-                    curr_row_node->header->count-=1;
-                    optional_header_tree.insert(curr_row_node->header);
+                solution_count++;
+            }
+            end_search();
+        }
+        if (solution_count<1) {
+            report_unsolved();
+            return vector<output_format>();
+        }
+        return solutions;
+    }
+    // This runs the same search as solve on several threads (see run_parallel for how the work is shared).
+    // Solutions are returned in the order solve would find them, unless max_solutions cuts the search short,
+    // in which case exactly max_solutions solutions are returned but not necessarily the first ones.
+    // num_threads: number of worker threads, or 0 to use one per hardware thread.
+    // Only the solutions and none save settings can be split, other settings fall back to solve.
+    vector<output_format> solve_parallel(input_format data_in, int max_solutions, int num_threads=0, dlx_save_setting save_setting=dlx_save_setting::solutions) {
+        if (save_setting == dlx_save_setting::correct_moves || save_setting == dlx_save_setting::all_moves) {
+            return solve(data_in, max_solutions, save_setting);
+        }
+        if (max_solutions==-1) {
+            max_solutions = numeric_limits<int>::max();
+        }
+        vector<vector<output_format> > task_solutions;
+        mutex solutions_lock;
+        atomic<int> solution_count(0);
+        atomic<bool> stop(false);
+        vector<int> task_order;
+        bool initialized = run_parallel(data_in, num_threads, stop, [&](dlx_matrix& worker, int task_num) {
+            vector<output_format> found;
+            while (worker.next_solution()) {
+                if (solution_count.fetch_add(1)>=max_solutions) {
+                    stop = true;
+                    break;
                 }
-#ifdef DEBUG
-                if (curr_row_node->header->top==NULL||curr_row_node->header->bottom==NULL) {
-                    cout << "Null top and bottom nodes on header, count " << curr_row_node->header->count << endl;
-                    exit(1);
+                if (save_setting == dlx_save_setting::solutions) {
+                    found.push_back(worker.interpret(worker.backtrack_stack));
+                }
+            }
+            // tasks are still being added while others run, so each one's solutions are only stored once it ends
+            lock_guard<mutex> lock(solutions_lock);
+            if (task_solutions.size()<=task_num) {
+                task_solutions.resize(task_num+1);
+            }
+            task_solutions[task_num].swap(found);
+        }, &task_order);
+        if (!initialized) {
+            return vector<output_format>();
+        }
+        vector<output_format> solutions;
+        for (int i = 0; i < task_order.size(); i++) {
+            int task_num = task_order[i];
+            for (int j = 0; task_num < task_solutions.size() && j < task_solutions[task_num].size() && solutions.size()<max_solutions; j++) {
+                solutions.push_back(task_solutions[task_num][j]);
+            }
+        }
+        search_stats.solutions = solutions.size();
+        if (solution_count.load()<1) {
+            report_unsolved();
+        }
+        return solutions;
+    }
+    // Handle for pulling solutions one at a time from a search which stays suspended between calls, so that
+    // solutions can be streamed out or the search abandoned early without ever buffering them.
+    // The search state lives in the solver, so starting another search on the same solver (or calling reset) ends
+    // this one. The matrix is restored once the iterator runs out, but not if it is abandoned before then.
+    class solution_iterator {
+    public:
+        // Interprets the next solution into solution and returns true, or returns false once there are no more.
+        bool next(output_format &solution) {
+            if (solver==NULL) {
+                return false;
+            }
+            if (!solver->next_solution()) {
+                solver->end_search();
+                solver = NULL;
+                return false;
+            }
+            solution = solver->interpret(solver->backtrack_stack);
+            return true;
+        }
+        // Writes the next solution into a flat buffer of solution_size() ints and returns true, or returns false
+        // once there are no more. Unlike the other overload this does not allocate.
+        bool next(int* buffer) {
+            if (solver==NULL) {
+                return false;
+            }
+            if (!solver->next_solution()) {
+                solver->end_search();
+                solver = NULL;
+                return false;
+            }
+            chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+            solver->decode(solver->backtrack_stack, buffer);
+            solver->search_stats.interpret_us += chrono::duration<double,micro>(chrono::steady_clock::now()-start_time).count();
+            return true;
+        }
+    private:
+        friend class dlx_matrix;
+        solution_iterator(dlx_matrix* solver_in) : solver(solver_in) {}
+        dlx_matrix* solver;
+    };
+    // The moves recorded by trace. Each move places a row at a depth above the base board, replacing the row at
+    // that depth and any above it, so the log takes memory linear in the number of moves and boards are
+    // only built when they are asked for. Boards are decoded by the solver which made the trace, which must
+    // outlive it, but it may run other searches in the meantime.
+    class move_trace {
+    public:
+        // Returns the number of moves, each of which has a board.
+        int size() const {
+            return moves.size();
+        }
+        // Returns the board after the given move. The moves are replayed from the last board returned if it is
+        // earlier, so reading every board in order costs one pass over the moves plus a decode per board.
+        output_format board(int move_num) {
+            if (move_num<replayed_move) {
+                replayed_move = -1;
+                replay_stack.clear();
+            }
+            while (replayed_move<move_num) {
+                replayed_move++;
+                replay_stack.resize(moves[replayed_move].second);
+                replay_stack.push_back(moves[replayed_move].first);
+            }
+            output_format result = base;
+            for (int i = 0; i < replay_stack.size(); i++) {
+                solver->apply_row(result, replay_stack[i]);
+            }
+            return result;
+        }
+    private:
+        friend class dlx_matrix;
+        // Appends a move placing the row of node at the given depth.
+        void record(int node, int depth) {
+            moves.push_back({node,depth});
+        }
+        // The solver which made the trace, or NULL if the input was invalid.
+        const dlx_matrix* solver = NULL;
+        // The board the moves are placed on, such as the givens of a sudoku.
+        output_format base;
+        // The node and depth of every move.
+        vector<pair<int,int> > moves;
+        // The last move replayed and the rows placed after it, from the bottom of the backtrack stack up.
+        int replayed_move = -1;
+        vector<int> replay_stack;
+    };
+    // Runs the same search as solve with the correct_moves or all_moves save setting, but records the moves in
+    // a move_trace instead of building their boards. With correct_moves the trace places the rows of each
+    // solution in turn, with all_moves it holds every row forced by propagation and then every row the search selected.
+    move_trace trace(input_format data_in, int max_solutions, dlx_save_setting save_setting) {
+        move_trace moves;
+        int solution_count = 0;
+        if (max_solutions==-1) {
+            max_solutions = numeric_limits<int>::max();
+        }
+        if (!begin_search(data_in)) {
+            return moves;
+        }
+        moves.solver = this;
+        moves.base = interpret(vector<pair<int,int> >());
+        if (save_setting == dlx_save_setting::all_moves) {
+            // rows forced by propagate count as moves made before the search's own
+            for (int i = 0; i < propagated_base; i++) {
+                moves.record(backtrack_stack[i].second, i);
+            }
+            move_log = &moves;
+        }
+        while (solution_count<max_solutions&&next_solution()) {
+            if (save_setting == dlx_save_setting::correct_moves) {
+                for (int i = 0; i < backtrack_stack.size(); i++) {
+                    moves.record(backtrack_stack[i].second, i);
                 }
+            }
+            solution_count++;
+        }
+        move_log = NULL;
+        end_search();
+        return moves;
+    }
+    // Solutions kept in the packed encoding of the solver which found them, back to back in one array, so
+    // that storing millions of them takes a few dozen bytes each and no allocation per solution. Solutions
+    // are only decoded when they are asked for. As with move_trace, the solver must outlive the store.
+    class solution_store {
+    public:
+        // Returns the number of solutions stored.
+        size_t size() const {
+            return packed_size==0?0:data.size()/packed_size;
+        }
+        // Returns the number of bytes each solution takes.
+        int bytes_per_solution() const {
+            return packed_size;
+        }
+        // Returns the packed encoding of the given solution.
+        const unsigned char* packed(size_t solution_num) const {
+            return &data[solution_num*packed_size];
+        }
+        // Writes the given solution into a flat buffer of solution_size() ints, as solution_iterator::next does.
+        void get(size_t solution_num, int* buffer) const {
+            copy(base.begin(), base.end(), buffer);
+            solver->unpack(packed(solution_num), buffer);
+        }
+        // Returns the given solution as a board, the same as solve would have returned it.
+        output_format board(size_t solution_num) const {
+            vector<int> cells(base.size());
+            get(solution_num, &cells[0]);
+            return solver->unflatten(&cells[0]);
+        }
+    private:
+        friend class dlx_matrix;
+        // The solver which found the solutions, or NULL if the input was invalid.
+        const dlx_matrix* solver = NULL;
+        int packed_size = 0;
+        // The flat board before any choices, which unpack writes the cells of each solution over.
+        vector<int> base;
+        vector<unsigned char> data;
+    };
+    // Runs the same search as solve with the solutions save setting, but keeps the solutions packed in a
+    // solution_store instead of building a board for each.
+    solution_store solve_packed(input_format data_in, int max_solutions=-1) {
+        solution_store solutions;
+        long long solution_count = 0;
+        if (max_solutions==-1) {
+            max_solutions = numeric_limits<int>::max();
+        }
+        if (!begin_search(data_in)) {
+            return solutions;
+        }
+        solutions.solver = this;
+        solutions.packed_size = packed_size();
+        solutions.base.resize(solution_size());
+        decode(vector<pair<int,int> >(), &solutions.base[0]);
+        vector<int> cells(solution_size());
+        while (solution_count<max_solutions&&next_solution()) {
+            chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+            decode(backtrack_stack, &cells[0]);
+            solutions.data.resize(solutions.data.size()+solutions.packed_size);
+            pack(&cells[0], &solutions.data[solutions.data.size()-solutions.packed_size]);
+            search_stats.interpret_us += chrono::duration<double,micro>(chrono::steady_clock::now()-start_time).count();
+            solution_count++;
+        }
+        search_stats.solutions = solution_count;
+        if (solution_count==0) {
+            report_unsolved();
+        }
+        end_search();
+        return solutions;
+    }
+    // Starts a search over data_in and returns an iterator over its solutions, in the same order solve finds
+    // them. The iterator is empty if the input is invalid.
+    solution_iterator enumerate(input_format data_in) {
+        return solution_iterator(begin_search(data_in)?this:NULL);
+    }
+    // Calls on_solution with each solution in turn until it returns false or the solutions run out.
+    // Returns the number of solutions passed to on_solution.
+    unsigned long long for_each_solution(input_format data_in, const function<bool(const output_format&)> &on_solution) {
+        unsigned long long solution_count = 0;
+        solution_iterator solutions = enumerate(data_in);
+        output_format solution;
+        while (solutions.next(solution)) {
+            solution_count++;
+            if (!on_solution(solution)) {
+                break;
+            }
+        }
+        return solution_count;
+    }
+    // Counts the solutions to a problem without saving or interpreting any of them, which makes it faster
+    // than solve with the none save setting. Returns 0 if there are no solutions or the input is invalid.
+    unsigned long long count(input_format data_in) {
+        if (!begin_search(data_in)) {
+            return 0;
+        }
+        unsigned long long solution_count = count_subtree();
+        end_search();
+        return solution_count;
+    }
+    // Checks whether the input has no solution, exactly one, or more than one, stopping the search at the
+    // second solution. Solutions are not interpreted, except for the first when first_solution is given.
+    dlx_uniqueness verify_unique(input_format data_in, output_format* first_solution=NULL) {
+        if (!begin_search(data_in)) {
+            return dlx_uniqueness::none;
+        }
+        dlx_uniqueness result = dlx_uniqueness::none;
+        if (next_solution()) {
+            result = dlx_uniqueness::unique;
+            if (first_solution!=NULL) {
+                *first_solution = interpret(backtrack_stack);
+            }
+            if (next_solution()) {
+                result = dlx_uniqueness::multiple;
+            }
+        }
+        end_search();
+        return result;
+    }
+    // The same as count, but the search is shared between threads as in solve_parallel.
+    unsigned long long count_parallel(input_format data_in, int num_threads=0) {
+        atomic<unsigned long long> solution_count(0);
+        atomic<bool> stop(false);
+        run_parallel(data_in, num_threads, stop, [&](dlx_matrix& worker, int task_num) {
+            solution_count += worker.count_subtree();
+        });
+        search_stats.solutions = solution_count.load();
+        return solution_count.load();
+    }
+    // The number of tasks solve_parallel aims to create for each worker thread before the workers start, more
+    // tasks balance better but each one costs a replay of its prefix.
+    int parallel_tasks_per_thread = 16;
+    // Ends any search still in progress (such as one left by an abandoned solution_iterator), restoring the
+    // matrix to the state it was generated in. Every other entry point does this itself before returning.
+    void reset() {
+        end_search();
+    }
+    // Returns the statistics of the last search, including how it ended. Results from a search stopped by its
+    // limits are partial, and verify_unique's answer only holds if the search completed.
+    const dlx_search_stats& last_search() const {
+        return search_stats;
+    }
+    // Returns the number of ints in a flat solution, as written by solution_iterator::next(int*). The grid
+    // based solvers write their board row by row.
+    virtual int solution_size() const = 0;
+    // Returns the number of bytes in the packed encoding of a solution, as kept by solution_store.
+    virtual int packed_size() const = 0;
+    // Returns the number of bytes allocated for the matrix: its nodes, the column, row and color of every node, and
+    // the column headers.
+    size_t matrix_memory() const {
+        return matrix.capacity()*sizeof(dlx_matrix_node)+(node_header.capacity()+node_row.capacity()+row_start.capacity()+node_color.capacity())*sizeof(int)+matrix_header.capacity()*sizeof(dlx_header_node);
+    }
+    // The limits applied to every search, none by default.
+    dlx_search_limits limits;
+    // The randomization applied to every search, none by default. count and the parallel entry points randomize
+    // their order but never restart.
+    dlx_search_randomization randomization;
+    // When set, the solver prints nothing about input it cannot solve, which callers can still tell from
+    // last_search().status. Solvers used on several threads at once should set it, as they would share cout.
+    bool quiet = false;
+protected:
+    // Prints a message about the input of a search, unless quiet is set.
+    void report(const string &message) const {
+        if (!quiet) {
+            cout << message;
+        }
+    }
+    // Reports a search which found no solution. That only shows there is none if the search ran to completion,
+    // rather than being stopped by one of its limits.
+    void report_unsolved() const {
+        report((search_stats.status==dlx_search_status::completed)?"Unable to solve.\n":"Search limit reached.\n");
+    }
+    // Ends any previous search, resets the column indexes and runs initialize for a new search.
+    // Returns false (with the matrix restored) if the input is invalid.
+    bool begin_search(input_format &data_in) {
+        end_search();
+        chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+#ifdef DEBUG
+        pristine_matrix = matrix;
+        pristine_header = matrix_header;
 #endif
-                if (curr_row_node->header->count==0) {
-                    curr_row_node->header->top = NULL;
-                    curr_row_node->header->bottom = NULL;
+        int primary_end = min(optional_constraint_start_column,array_width);
+        int max_count = 0;
+        for (int i = 0; i < array_width; i++) {
+            max_count = max(max_count,matrix_header[i].count);
+        }
+        header_tree.reset(0,primary_end,max_count);
+        optional_header_tree.reset(primary_end,array_width,max_count);
+        for (int i = 0; i<primary_end; i++) {
+            header_tree.insert(&matrix_header[i]);
+        }
+        for (int i = primary_end; i < array_width; i++) {
+            optional_header_tree.insert(&matrix_header[i]);
+        }
+        backtrack_stack.clear();
+        last_rows.clear();
+        search_base = 0;
+        search_resume = false;
+        search_stats = dlx_search_stats();
+        search_stats.generation_us = generation_us;
+        bool has_limits = limits.cancel!=NULL||limits.max_attempts!=-1||limits.deadline!=chrono::steady_clock::time_point::max();
+        next_limit_check = (has_limits||share_work)?0:numeric_limits<long long>::max();
+        random_state = randomization.seed;
+        bool has_restarts = randomization.seed!=0&&randomization.restarts!=dlx_restart_schedule::none;
+        next_restart = has_restarts?restart_budget(1):numeric_limits<long long>::max();
+        //verify_matrix();
+        if (!initialize(data_in,header_tree,optional_header_tree)) {
+            search_stats.status = dlx_search_status::invalid_input;
+            end_search();
+            return false;
+        }
+        if (do_propagation) {
+            propagate();
+        }
+        search_start = chrono::steady_clock::now();
+        search_stats.initialize_us = chrono::duration<double,micro>(search_start-start_time).count();
+        search_timed = true;
+        return true;
+    }
+    // Undoes every choice on the backtrack stack and every fixed move, in reverse order, which leaves the
+    // matrix exactly as it was generated. Does nothing if no search is in progress.
+    void end_search() {
+        if (search_timed) {
+            search_stats.search_us = chrono::duration<double,micro>(chrono::steady_clock::now()-search_start).count();
+            search_timed = false;
+        }
+        while (backtrack_stack.size()>propagated_base) {
+            deselect_row();
+        }
+        search_base = 0;
+        propagated_base = 0;
+        search_resume = false;
+        while (!fixed_moves.empty()) {
+            dlx_fixed_move move = fixed_moves.back();
+            fixed_moves.pop_back();
+            if (move.type==dlx_fixed_move_type::forced_row) {
+                deselect_row();
+                continue;
+            }
+            if (move.type==dlx_fixed_move_type::eliminated_row) {
+                int curr_node = move.node;
+                do {
+                    curr_node = matrix[curr_node].left;
+                    unhide_node(curr_node, header_tree, optional_header_tree);
+                } while (curr_node!=move.node);
+                continue;
+            }
+            if (move.type==dlx_fixed_move_type::excluded_column) {
+                if (move.node!=-1) {
+                    unhide_row(move.node, header_tree, optional_header_tree);
+                    restore_column(move.node, header_tree, optional_header_tree);
+                }
+            }
+            else {
+                restore_row(move.node, header_tree, optional_header_tree);
+                // a row fixed through a colored node only purified the node's column
+                if (!node_color.empty()&&node_color[move.node]!=0) {
+                    if (node_color[move.node]>0) {
+                        unpurify(move.node, header_tree, optional_header_tree);
+                    }
+                    continue;
                 }
+                restore_column(move.node, header_tree, optional_header_tree);
+            }
+            if (move.column<optional_constraint_start_column) {
+                header_tree.insert(&matrix_header[move.column]);
+            }
+            else {
+                optional_header_tree.insert(&matrix_header[move.column]);
+            }
+        }
 #ifdef DEBUG
-                else if (curr_row_node->header->count<0) {
-                    cout << "Negative count in remove.\n";
-                    exit(1);
+        for (int i = 0; i < pristine_matrix.size(); i++) {
+            if (matrix[i].left!=pristine_matrix[i].left||matrix[i].right!=pristine_matrix[i].right||matrix[i].up!=pristine_matrix[i].up||matrix[i].down!=pristine_matrix[i].down) {
+                cout << "Node " << i << " was not restored.\n";
+                exit(1);
+            }
+        }
+        for (int i = 0; i < pristine_header.size(); i++) {
+            if (matrix_header[i].count!=pristine_header[i].count||matrix_header[i].top!=pristine_header[i].top||matrix_header[i].bottom!=pristine_header[i].bottom) {
+                cout << "Header " << i << " was not restored.\n";
+                exit(1);
+            }
+        }
+#endif
+    }
+    // Fixes the row of the given node into the solution for the rest of the search, for use by initialize.
+    // Returns false if the row conflicts with the rows fixed so far, or if fixing it would leave a mandatory
+    // column with no way to be satisfied.
+    bool fix_row(int node) {
+        int curr_node = node;
+        do {
+            int curr_column = node_header[curr_node];
+            if (!(curr_column<optional_constraint_start_column?header_tree:optional_header_tree).contains(&matrix_header[curr_column])) {
+                return false;
+            }
+            curr_node = matrix[curr_node].right;
+        } while (curr_node!=node);
+        int column = node_header[node];
+        if (!node_color.empty()&&node_color[node]!=0) {
+            // a colored node leaves its column open to the rows which agree on the color, as in remove_row
+            if (node_color[node]>0) {
+                purify(node, header_tree, optional_header_tree);
+            }
+        }
+        else {
+            if (column<optional_constraint_start_column) {
+                header_tree.erase(&matrix_header[column]);
+            }
+            else {
+                optional_header_tree.erase(&matrix_header[column]);
+            }
+            remove_column(node, header_tree, optional_header_tree);
+        }
+        remove_row(node, header_tree, optional_header_tree);
+        fixed_moves.push_back({column,node,dlx_fixed_move_type::fixed_row});
+        return header_tree.empty()||header_tree.lowest_count()>0;
+    }
+    // Removes a column and every row which covers it for the rest of the search, for use by initialize.
+    // This is used for constraints which are already satisfied, such as blocked cells on a board.
+    void exclude_column(int column) {
+        dlx_header_node* header = &matrix_header[column];
+        int node = header->top;
+        if (column<optional_constraint_start_column) {
+            header_tree.erase(header);
+        }
+        else {
+            optional_header_tree.erase(header);
+        }
+        if (node!=-1) {
+            remove_column(node, header_tree, optional_header_tree);
+            hide_row(node, header_tree, optional_header_tree);
+        }
+        fixed_moves.push_back({column,node,dlx_fixed_move_type::excluded_column});
+    }
+    // Runs before the search (when do_propagation is set) to make the moves which hold in every solution:
+    // a mandatory column with a single row left forces that row, which covers naked and hidden singles in a
+    // sudoku, and rows ruled out by eliminate_dominated_rows are removed. The forced rows are left at the bottom
+    // of the backtrack stack, below search_base, so that interpret_result sees them like any other choice.
+    // If a mandatory column is left with no rows the search is left with nothing to find.
+    void propagate() {
+        int primary_end = min(optional_constraint_start_column,array_width);
+        domination_queued.assign(primary_end,1);
+        domination_queue.clear();
+        for (int column = 0; column < primary_end; column++) {
+            domination_queue.push_back(column);
+        }
+        while (!header_tree.empty()&&header_tree.lowest_count()>0) {
+            if (header_tree.lowest_count()==1) {
+                int column = header_tree.front_column();
+                int node = matrix_header[column].top;
+                // the rows which select_row hides leave the columns they cover with fewer rows to check
+                int curr_node = node;
+                do {
+                    for (int row_node = matrix[curr_node].down; row_node!=curr_node; row_node = matrix[row_node].down) {
+                        queue_row_columns(row_node);
+                    }
+                    curr_node = matrix[curr_node].right;
+                } while (curr_node!=node);
+                select_row(column, node);
+                fixed_moves.push_back({column,node,dlx_fixed_move_type::forced_row});
+            }
+            else if (!eliminate_dominated_rows()) {
+                break;
+            }
+        }
+        domination_queue.clear();
+        propagated_base = backtrack_stack.size();
+        search_base = propagated_base;
+    }
+    // Adds the mandatory columns covered by the row of the given node to the columns eliminate_dominated_rows
+    // has left to check, as that row is about to be hidden.
+    void queue_row_columns(int node) {
+        int curr_node = node;
+        do {
+            int column = node_header[curr_node];
+            if (column<domination_queued.size()&&!domination_queued[column]) {
+                domination_queued[column] = 1;
+                domination_queue.push_back(column);
+            }
+            curr_node = matrix[curr_node].right;
+        } while (curr_node!=node);
+    }
+    // Looks for a mandatory column whose remaining rows all cover some other column. One of those rows must be in
+    // every solution, so the other column's remaining rows which do not also cover the first can never be chosen.
+    // In a sudoku this is locked candidates: a value confined to one line within a box is ruled out from the rest
+    // of that line, and a value confined to one box within a line is ruled out from the rest of that box.
+    // Only the columns on domination_queue are checked, since a column can only come to dominate another once
+    // some of its rows are hidden. Eliminates the rows of the first such pair found and returns true, or returns
+    // false once the queue is empty.
+    bool eliminate_dominated_rows() {
+        while (!domination_queue.empty()) {
+            int column = domination_queue.back();
+            domination_queue.pop_back();
+            domination_queued[column] = 0;
+            dlx_header_node* header = &matrix_header[column];
+            if (!header_tree.contains(header)||header->count<2) {
+                continue;
+            }
+            // any column covered by every row of this column is covered by its top row in particular
+            int top = header->top;
+            for (int candidate_node = matrix[top].right; candidate_node!=top; candidate_node = matrix[candidate_node].right) {
+                int candidate_column = node_header[candidate_node];
+                if (matrix_header[candidate_column].count<=header->count||(!column_capacity.empty()&&column_capacity[candidate_column]>1)||(!node_color.empty()&&candidate_column>=optional_constraint_start_column)) {
+                    continue;
+                }
+                bool dominated = true;
+                for (int row_node = matrix[top].down; row_node!=top&&dominated; row_node = matrix[row_node].down) {
+                    dominated = row_covers(row_node, candidate_column);
+                }
+                if (!dominated) {
+                    continue;
+                }
+                vector<int> eliminated_nodes;
+                int candidate_top = matrix_header[candidate_column].top;
+                int curr_node = candidate_top;
+                do {
+                    if (!row_covers(curr_node, column)) {
+                        eliminated_nodes.push_back(curr_node);
+                    }
+                    curr_node = matrix[curr_node].down;
+                } while (curr_node!=candidate_top);
+                for (int i = 0; i < eliminated_nodes.size(); i++) {
+                    queue_row_columns(eliminated_nodes[i]);
+                    eliminate_row(eliminated_nodes[i]);
+                }
+                // the column may dominate another of its candidates as well
+                if (!domination_queued[column]) {
+                    domination_queued[column] = 1;
+                    domination_queue.push_back(column);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+    // Returns true if the row of the given node has a node in the given column.
+    inline bool row_covers(int node, int column) {
+        int curr_node = node;
+        do {
+            if (node_header[curr_node]==column) {
+                return true;
+            }
+            curr_node = matrix[curr_node].right;
+        } while (curr_node!=node);
+        return false;
+    }
+    // Unlinks every node of a row from its column for the rest of the search.
+    void eliminate_row(int node) {
+        int curr_node = node;
+        do {
+            hide_node(curr_node, header_tree, optional_header_tree);
+            curr_node = matrix[curr_node].right;
+        } while (curr_node!=node);
+        fixed_moves.push_back({node_header[node],node,dlx_fixed_move_type::eliminated_row});
+    }
+    // Continues the search until the next solution, which is left on the backtrack stack. Returns false once
+    // every choice above search_base has been tried. Calling it again after a solution resumes the search.
+    inline bool next_solution() {
+        if (search_resume && !advance()) {
+            search_resume = false;
+            return false;
+        }
+        while (true) {
+            if (limit_reached()) {
+                search_resume = false;
+                return false;
+            }
+            if (search_stats.attempts>=next_restart) {
+                restart();
+            }
+            if (header_tree.empty()) {
+                search_resume = true;
+                search_stats.solutions++;
+                next_restart = numeric_limits<long long>::max();
+                return true;
+            }
+            else if (is_dead_end()) {
+                if (!advance()) {
+                    search_resume = false;
+                    return false;
                 }
-#endif
-                else {
-                    if (curr_row_node==curr_row_node->header->top) {
-                        curr_row_node->header->top = curr_row_node->down;
-                    }
-                    else if (curr_row_node==curr_row_node->header->bottom) {
-                        curr_row_node->header->bottom = curr_row_node->up;
-                    }
-                    curr_row_node->up->down = curr_row_node->down;
-                    curr_row_node->down->up = curr_row_node->up;
+            }
+            else { // get the constraint with the fewest satisfaction options remaining
+            // attempt to satisfy the first option by removing the row that
+            // represents it, the constraint columns that it satisfies,
+            // and all rows which also satisfy those constraints
+                choose_next_column();
+                if (move_log!=NULL) {
+                    move_log->record(backtrack_stack.back().second, backtrack_stack.size()-1);
                 }
             }
         }
     }
-    // Restores a removed (previously selected) row by restoring all attached columns.
-    inline void restore_row(dlx_matrix_node* given_row_node, set<dlx_header_node*,header_compare> &header_tree, set<dlx_header_node*,header_compare> &optional_header_tree) {
-        // visits all columns except the one attached to the given node
-        for (dlx_matrix_node* base_row_node = given_row_node->left; base_row_node!=given_row_node; base_row_node=base_row_node->left) {
-            restore_column(base_row_node, header_tree, optional_header_tree);
-            if (base_row_node->header->matrix_column<optional_constraint_start_column) {
-                header_tree.insert(base_row_node->header);
-            }
-            else {
-                optional_header_tree.insert(base_row_node->header);
+    // Returns true if the current state has no solution because a mandatory column has no rows left, or because
+    // prune_state says so when do_pruning is set.
+    inline bool is_dead_end() {
+        if (header_tree.lowest_count()<=0) {
+            return true;
+        }
+        if (do_pruning&&prune_state()) {
+            search_stats.pruned++;
+            return true;
+        }
+        return false;
+    }
+    // Called on each state of a search with do_pruning set in which every mandatory column still has rows left.
+    // A problem may override it to return true when it can tell the state has no solution some other way, which
+    // must never happen for a state which has one.
+    virtual bool prune_state() {
+        return false;
+    }
+    // Undoes choices until one has an untried row left and selects that row instead.
+    // Returns false if there are no choices above search_base left to change.
+    inline bool advance() {
+        while (backtrack_stack.size()>search_base&&last_rows.back()==backtrack_stack.back().second) {
+            deselect_row();
+        }
+        if (backtrack_stack.size()==search_base) {
+            return false;
+        }
+        search_stats.attempts++;
+        search_stats.backtracks++;
+        int curr_header = backtrack_stack.back().first;
+        int curr_node = matrix[backtrack_stack.back().second].down;
+        restore_row(backtrack_stack.back().second, header_tree, optional_header_tree);
+        restore_column(backtrack_stack.back().second, header_tree, optional_header_tree);
+        remove_column(curr_node, header_tree, optional_header_tree);
+        backtrack_stack.back() = {curr_header,curr_node};
+        remove_row(curr_node, header_tree, optional_header_tree);
+        if (move_log!=NULL) {
+            move_log->record(curr_node, backtrack_stack.size()-1);
+        }
+        return true;
+    }
+    // Abandons the current run of a randomized search, which has used up its attempt budget without finding a
+    // solution, and begins the next run from search_base with the next budget.
+    void restart() {
+        while (backtrack_stack.size()>search_base) {
+            deselect_row();
+        }
+        search_stats.restarts++;
+        next_restart = search_stats.attempts+restart_budget(search_stats.restarts+1);
+    }
+    // Returns the attempt budget of the given run (from 1) of a search with restarts.
+    // The budget is at least 1 and grows without bound whatever the settings, so every search still finishes.
+    long long restart_budget(long long run) const {
+        long long base = max(randomization.restart_base,1LL);
+        if (randomization.restarts==dlx_restart_schedule::luby) {
+            return base*dlx_luby(run);
+        }
+        double growth = (randomization.restart_growth<dlx_search_randomization::min_restart_growth)?dlx_search_randomization::min_restart_growth:randomization.restart_growth;
+        double budget = base*pow(growth,(double)(run-1));
+        return (budget>=(double)(numeric_limits<long long>::max()/2))?numeric_limits<long long>::max()/2:(long long)budget;
+    }
+    // Returns the next number of the search's random sequence (xorshift64*).
+    inline unsigned long long next_random() {
+        random_state ^= random_state>>12;
+        random_state ^= random_state<<25;
+        random_state ^= random_state>>27;
+        return random_state*2685821657736338717ULL;
+    }
+    // Adds the counts from a parallel search's worker to this search's stats. The first limit a worker stopped
+    // at becomes the status.
+    void add_worker_stats(const dlx_search_stats &worker_stats) {
+        if (search_stats.status==dlx_search_status::completed) {
+            search_stats.status = worker_stats.status;
+        }
+        search_stats.attempts += worker_stats.attempts;
+        search_stats.backtracks += worker_stats.backtracks;
+        search_stats.restarts += worker_stats.restarts;
+        search_stats.pruned += worker_stats.pruned;
+        search_stats.link_updates += worker_stats.link_updates;
+        search_stats.max_depth = max(search_stats.max_depth,worker_stats.max_depth);
+        if (worker_stats.depth_choices.size()>search_stats.depth_choices.size()) {
+            search_stats.depth_choices.resize(worker_stats.depth_choices.size());
+            search_stats.depth_rows.resize(worker_stats.depth_rows.size());
+        }
+        for (int i = 0; i < worker_stats.depth_choices.size(); i++) {
+            search_stats.depth_choices[i] += worker_stats.depth_choices[i];
+            search_stats.depth_rows[i] += worker_stats.depth_rows[i];
+        }
+        search_stats.interpret_us += worker_stats.interpret_us;
+    }
+    // Makes the search's next choice: the front column of the index, or a random one of the columns tied with it
+    // when the search is randomized.
+    inline void choose_next_column() {
+        choose_column(random_state==0?header_tree.front_column():header_tree.random_front_column(next_random()));
+    }
+    // Makes the search's next choice: the first remaining row of the given column (or a random row when the
+    // search is randomized, after which the rows are tried in order, wrapping around), recording the choice in
+    // the stats.
+    inline void choose_column(int column) {
+        int depth = backtrack_stack.size();
+        if (depth>=search_stats.depth_choices.size()) {
+            search_stats.depth_choices.resize(depth+1);
+            search_stats.depth_rows.resize(depth+1);
+            search_stats.max_depth = depth+1;
+        }
+        search_stats.attempts++;
+        search_stats.depth_choices[depth]++;
+        search_stats.depth_rows[depth] += matrix_header[column].count;
+        int node = matrix_header[column].top;
+        if (random_state!=0) {
+            for (int skip = next_random()%matrix_header[column].count; skip > 0; skip--) {
+                node = matrix[node].down;
             }
         }
+        select_row(column, node);
     }
-    // Removes a row by removing all attached columns.
-    inline void remove_row(dlx_matrix_node* given_row_node, set<dlx_header_node*,header_compare> &header_tree, set<dlx_header_node*,header_compare> &optional_header_tree) {
-        // visits all columns except the one attached to the given node
-        for (dlx_matrix_node* base_row_node = given_row_node->right; base_row_node!=given_row_node; base_row_node=base_row_node->right) {
-            if (base_row_node->header->matrix_column<optional_constraint_start_column) {
-                header_tree.erase(base_row_node->header);
+    // Interprets the solution given by a sequence of choices, adding the time it takes to the stats.
+    output_format interpret(const vector<pair<int,int> > &choices) {
+        chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+        output_format result = interpret_result(choices);
+        search_stats.interpret_us += chrono::duration<double,micro>(chrono::steady_clock::now()-start_time).count();
+        return result;
+    }
+    // Chooses the row of the given node to satisfy the given column and pushes the choice on the backtrack stack.
+    inline void select_row(int column, int node) {
+        backtrack_stack.push_back({column,node});
+        last_rows.push_back(matrix[node].up);
+        header_tree.erase(&matrix_header[column]);
+        remove_column(node, header_tree, optional_header_tree);
+        remove_row(node, header_tree, optional_header_tree);
+    }
+    // Undoes the choice on top of the backtrack stack.
+    inline void deselect_row() {
+        restore_row(backtrack_stack.back().second, header_tree,optional_header_tree);
+        restore_column(backtrack_stack.back().second, header_tree, optional_header_tree);
+        header_tree.insert(&matrix_header[backtrack_stack.back().first]);
+        backtrack_stack.pop_back();
+        last_rows.pop_back();
+    }
+    // Counts the solutions below search_base, leaving the backtrack stack at search_base.
+    // When a single mandatory column is left, each of its remaining rows completes a solution (any row that
+    // conflicts with the choices so far has already been unlinked), so they are counted without selecting them.
+    // This comes before prune_state, which may only reject states with no solution, so it cannot change the count.
+    unsigned long long count_subtree() {
+        unsigned long long solution_count = 0;
+        while (!limit_reached()) {
+            if (header_tree.size()<=1) {
+                solution_count += header_tree.empty()?1:header_tree.lowest_count();
+                if (!advance()) {
+                    break;
+                }
+            }
+            else if (is_dead_end()) {
+                if (!advance()) {
+                    break;
+                }
             }
             else {
-                optional_header_tree.erase(base_row_node->header);
+                choose_next_column();
             }
-            remove_column(base_row_node, header_tree, optional_header_tree);
         }
+        search_resume = false;
+        search_stats.solutions += solution_count;
+        return solution_count;
     }
-    // This wrapper may be used to automatically fetch only the first solution to a problem (if one exists).
-    inline output_format solve(input_format data_in) {
-        return solve(data_in,1)[0];
+    // Returns true if the search has to stop because of its limits. Only the attempt count is compared on most
+    // calls, the clock and the cancellation flag are read every limit_check_interval attempts.
+    inline bool limit_reached() {
+        return search_stats.attempts>=next_limit_check&&check_limits();
     }
-    // This function implements Knuth's Algorithm X with dancing links.
-    // The algorithm is complex, but essentially it just iterates over the exact cover matrix and 
-    // selects columns to satisfy, then iterates over the possible solutions.
-    // If it cannot find a solution, it undoes a choice and selects the next row. 
-    // If it runs out of choices to undo, there is no solution.
-    // If it runs out of columns to satisfy, a solution has been found.
-    // Finally, the number of solutions can be configured, and the problem states that get saved can also be configured.
-    vector<output_format> solve(input_format data_in, int max_solutions, dlx_save_setting save_setting=dlx_save_setting::solutions) {
-        chrono::high_resolution_clock::time_point start_time = chrono::high_resolution_clock::now();
-        chrono::high_resolution_clock::time_point prev_time;
-        int attempts = 0;
-        int solution_count = 0;
-        set<dlx_header_node*,header_compare> header_tree;
-        set<dlx_header_node*,header_compare> optional_header_tree;
-        stack<pair<dlx_header_node*,dlx_matrix_node*> > backtrack_stack;
-        vector<output_format> solutions;
-        if (max_solutions==-1) {
-            max_solutions = numeric_limits<int>::max();
+    bool check_limits() {
+        if (limits.cancel!=NULL&&limits.cancel->load(memory_order_relaxed)) {
+            search_stats.status = dlx_search_status::cancelled;
         }
-        prev_time = chrono::high_resolution_clock::now();
-        for (int i = 0; i<optional_constraint_start_column; i++) {
-            header_tree.insert(header_tree.end(),&matrix_header[i]);
+        else if (limits.max_attempts!=-1&&search_stats.attempts>=limits.max_attempts) {
+            search_stats.status = dlx_search_status::attempt_limit_reached;
         }
-        for (int i = optional_constraint_start_column; i < array_width; i++) {
-            optional_header_tree.insert(optional_header_tree.end(),&matrix_header[i]);
+        else if (chrono::steady_clock::now()>=limits.deadline) {
+            search_stats.status = dlx_search_status::timed_out;
         }
-        //verify_matrix();
-        prev_time = chrono::high_resolution_clock::now();
-        if (!initialize(data_in,header_tree,optional_header_tree)) {
-            return vector<output_format>();
+        if (search_stats.status!=dlx_search_status::completed) {
+            // once stopped, the search stays stopped until the next one begins
+            next_limit_check = 0;
+            return true;
+        }
+        if (share_work) {
+            share_work();
+        }
+        next_limit_check = search_stats.attempts+limit_check_interval;
+        if (limits.max_attempts!=-1) {
+            next_limit_check = min(next_limit_check,limits.max_attempts);
+        }
+        return false;
+    }
+    // Shared driver for the parallel entry points. The search tree is split at its first few branching levels
+    // into tasks (each a prefix of the choices solve would push on the backtrack stack), which are dealt out to
+    // per-worker deques. Each worker owns a copy of the matrix, so it has its own link state, and takes tasks
+    // from the back of its own deque or steals from the front of another's. While any worker is idle, the others
+    // split their own task again every limit_check_interval attempts (see split_untried) and push the pieces
+    // onto their deques, so a large subtree does not leave the rest of the workers waiting on one thread.
+    // run_task is called by a worker with its copy of the solver positioned at the base of a task, and workers
+    // stop taking tasks once stop is set. task_order, if given, receives the numbers of all the tasks in the
+    // order solve would search them. Returns false if the input could not be initialized.
+    bool run_parallel(input_format &data_in, int num_threads, atomic<bool> &stop, const function<void(dlx_matrix&,int)> &run_task, vector<int>* task_order=NULL) {
+        if (num_threads<=0) {
+            num_threads = max((int)thread::hardware_concurrency(),1);
         }
-        if (do_debug_output) {
-            cout << "Initialization took " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
-        }
-        prev_time = chrono::high_resolution_clock::now();
-        while (solution_count<max_solutions) {
-            if (header_tree.empty()||(*header_tree.begin())->count<=0/*||(!optional_header_tree.empty()&&(*optional_header_tree.begin())->count<0)*/) {
-                if (header_tree.empty()) {
-                    if (save_setting == dlx_save_setting::solutions) {
-                        if (do_debug_output)
-                            cout << "Found solution number " << solutions.size()+1 << endl;
-                        solutions.push_back(interpret_result(backtrack_stack));
+        // the workers copy the matrix before this instance runs initialize on it
+        vector<unique_ptr<dlx_matrix> > workers(num_threads);
+        for (int i = 0; i < num_threads; i++) {
+            workers[i].reset(clone());
+        }
+        if (!begin_search(data_in)) {
+            return false;
+        }
+        vector<vector<int> > tasks = split_search(num_threads*parallel_tasks_per_thread);
+        // the tasks in search order, as a list so that the pieces of a task can go in right after it
+        vector<int> next_task(tasks.size());
+        for (int i = 0; i < tasks.size(); i++) {
+            next_task[i] = i+1<tasks.size()?i+1:-1;
+        }
+        mutex tasks_lock;
+        vector<deque<int> > task_queues(num_threads);
+        vector<unique_ptr<mutex> > queue_locks(num_threads);
+        for (int i = 0; i < num_threads; i++) {
+            queue_locks[i].reset(new mutex());
+        }
+        for (int i = 0; i < tasks.size(); i++) {
+            task_queues[i%num_threads].push_back(i);
+        }
+        // a worker counts as busy from the moment it takes a task, so that none of them stops while a task it could
+        // have been handed is still running
+        atomic<int> busy_workers(num_threads);
+        vector<thread> threads;
+        for (int worker_num = 0; worker_num < num_threads; worker_num++) {
+            threads.push_back(thread([&,worker_num]() {
+                dlx_matrix& worker = *workers[worker_num];
+                int task_num = -1;
+                worker.share_work = [&]() {
+                    if (busy_workers.load()==num_threads) {
+                        return;
                     }
-                    else if (save_setting == dlx_save_setting::correct_moves) {
-                        stack<pair<dlx_header_node*, dlx_matrix_node*> > temporary_stack = backtrack_stack;
-                        stack<output_format> temporary_results;
-                        while (!temporary_stack.empty()) {
-                            temporary_results.push(interpret_result(temporary_stack));
-                            temporary_stack.pop();
+                    {
+                        lock_guard<mutex> lock(*queue_locks[worker_num]);
+                        if (!task_queues[worker_num].empty()) {
+                            return;
                         }
-                        cout << temporary_results.size() << endl;
-                        while (!temporary_results.empty()) {
-                            solutions.push_back(temporary_results.top());
-                            temporary_results.pop();
+                    }
+                    vector<vector<int> > pieces = worker.split_untried();
+                    if (pieces.empty()) {
+                        return;
+                    }
+                    lock_guard<mutex> lock(tasks_lock);
+                    int first_piece = tasks.size();
+                    for (int i = 0; i < pieces.size(); i++) {
+                        tasks.push_back(pieces[i]);
+                        next_task.push_back(i+1<pieces.size()?first_piece+i+1:next_task[task_num]);
+                    }
+                    next_task[task_num] = first_piece;
+                    lock_guard<mutex> queue_lock(*queue_locks[worker_num]);
+                    for (int i = pieces.size()-1; i >= 0; i--) {
+                        task_queues[worker_num].push_back(first_piece+i);
+                    }
+                };
+                if (!worker.begin_search(data_in)) {
+                    busy_workers--;
+                    return;
+                }
+                bool busy = true;
+                while (!stop.load()) {
+                    task_num = -1;
+                    for (int i = 0; i < num_threads && task_num==-1; i++) {
+                        int victim = (worker_num+i)%num_threads;
+                        lock_guard<mutex> lock(*queue_locks[victim]);
+                        if (!task_queues[victim].empty()) {
+                            if (victim==worker_num) {
+                                task_num = task_queues[victim].back();
+                                task_queues[victim].pop_back();
+                            }
+                            else {
+                                task_num = task_queues[victim].front();
+                                task_queues[victim].pop_front();
+                            }
+                            if (!busy) {
+                                busy_workers++;
+                                busy = true;
+                            }
                         }
                     }
-                    else {
-                        if ((solution_count%100000)==0&&do_debug_output) {
-                            cout << "Found solution number " << solutions.size()+1 << endl;
+                    if (task_num==-1) {
+                        if (busy) {
+                            busy_workers--;
+                            busy = false;
                         }
+                        if (busy_workers.load()==0) {
+                            break;
+                        }
+                        this_thread::sleep_for(chrono::microseconds(100));
+                        continue;
                     }
-                    solution_count++;
-                }
-                while (!backtrack_stack.empty()&&backtrack_stack.top().first->bottom==backtrack_stack.top().second) {
-                    restore_row(backtrack_stack.top().second, header_tree,optional_header_tree);
-                    restore_column(backtrack_stack.top().second, header_tree, optional_header_tree);
-                    header_tree.insert(backtrack_stack.top().first);
-                    backtrack_stack.pop();
-                }
-                if (backtrack_stack.empty()) {
-                    if (solution_count<1) {
-                        cout << "Unable to solve.\n";
-                        return vector<output_format>();
+                    vector<int> prefix;
+                    {
+                        lock_guard<mutex> lock(tasks_lock);
+                        prefix = tasks[task_num];
                     }
-                    else {
-                        if (do_debug_output)
-                            cout << "Solve took " << attempts << " attempts and " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
-                        return solutions;
+                    worker.push_prefix(prefix);
+                    run_task(worker, task_num);
+                    worker.pop_prefix();
+                    if (worker.search_stats.status!=dlx_search_status::completed) {
+                        stop = true;
                     }
                 }
-                attempts++;
-                dlx_header_node* curr_header = backtrack_stack.top().first;
-                dlx_matrix_node* curr_node = backtrack_stack.top().second->down;
-                restore_row(backtrack_stack.top().second, header_tree, optional_header_tree);
-                restore_column(backtrack_stack.top().second, header_tree, optional_header_tree);
-                remove_column(curr_node, header_tree, optional_header_tree);
-                backtrack_stack.pop();
-                backtrack_stack.push({curr_header,curr_node});
-                remove_row(curr_node, header_tree, optional_header_tree);
-                if (save_setting == dlx_save_setting::all_moves) {
-                    solutions.push_back(interpret_result(backtrack_stack));
+                if (busy) {
+                    busy_workers--;
                 }
+            }));
+        }
+        for (int i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        for (int i = 0; i < num_threads; i++) {
+            add_worker_stats(workers[i]->search_stats);
+        }
+        if (task_order!=NULL) {
+            task_order->clear();
+            for (int i = tasks.empty()?-1:0; i != -1; i = next_task[i]) {
+                task_order->push_back(i);
             }
-            else { // get the constraint with the fewest satisfaction options remaining
-            // attempt to satisfy the first option by removing the row that
-            // represents it, the constraint columns that it satisfies,
-            // and all rows which also satisfy those constraints
-            // also remove 
-                attempts++;
-                dlx_header_node* curr_header = *header_tree.begin();
-                dlx_matrix_node* curr_node = curr_header->top;
-                backtrack_stack.push({curr_header,curr_node});
-                header_tree.erase(curr_header);
-                remove_column(curr_node, header_tree, optional_header_tree);
-                remove_row(curr_node, header_tree, optional_header_tree);
-                if (save_setting == dlx_save_setting::all_moves) {
-                    solutions.push_back(interpret_result(backtrack_stack));
+        }
+        end_search();
+        return true;
+    }
+    // Runs the search only as deep as needed to split it into at least min_tasks subtrees (or until the
+    // depth limit), returning each subtree as the list of nodes chosen to reach it. A solution found above
+    // the split depth is returned as a task of its own. Leaves the backtrack stack at propagated_base, and the
+    // tasks only hold the choices above it.
+    vector<vector<int> > split_search(int min_tasks) {
+        vector<vector<int> > tasks;
+        for (int depth = 1; depth <= max_split_depth; depth++) {
+            tasks.clear();
+            bool reached_depth = false;
+            while (true) {
+                bool at_task = header_tree.empty() || backtrack_stack.size()==propagated_base+depth;
+                if (at_task) {
+                    reached_depth = reached_depth || !header_tree.empty();
+                    tasks.push_back(vector<int>(backtrack_stack.size()-propagated_base));
+                    for (int i = 0; i < tasks.back().size(); i++) {
+                        tasks.back()[i] = backtrack_stack[propagated_base+i].second;
+                    }
+                }
+                if (at_task || is_dead_end()) {
+                    if (!advance()) {
+                        break;
+                    }
+                }
+                else {
+                    int curr_header = header_tree.front_column();
+                    select_row(curr_header, matrix_header[curr_header].top);
                 }
             }
+            if (tasks.size()>=min_tasks || !reached_depth) {
+                break;
+            }
         }
-        if (do_debug_output)
-            cout << "Solve took " << attempts << " attempts and " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
-        return solutions;
+        return tasks;
+    }
+    // Hands over the rows the search has yet to try at its shallowest choice above search_base which has any,
+    // returning a task for each in the order advance would have tried them, in the form split_search uses. The
+    // search goes on with the rest of its subtree, all of which solve would search before those tasks.
+    vector<vector<int> > split_untried() {
+        vector<vector<int> > pieces;
+        for (int depth = search_base; depth < backtrack_stack.size(); depth++) {
+            if (last_rows[depth]==backtrack_stack[depth].second) {
+                continue;
+            }
+            vector<int> prefix(depth-propagated_base+1);
+            for (int i = propagated_base; i < depth; i++) {
+                prefix[i-propagated_base] = backtrack_stack[i].second;
+            }
+            int curr_node = backtrack_stack[depth].second;
+            do {
+                curr_node = matrix[curr_node].down;
+                prefix.back() = curr_node;
+                pieces.push_back(prefix);
+            } while (curr_node!=last_rows[depth]);
+            last_rows[depth] = backtrack_stack[depth].second;
+            break;
+        }
+        return pieces;
+    }
+    // Selects each node in a task from split_search and makes it the base of the search.
+    void push_prefix(const vector<int> &prefix) {
+        for (int i = 0; i < prefix.size(); i++) {
+            select_row(node_header[prefix[i]], prefix[i]);
+        }
+        search_base = backtrack_stack.size();
+        search_resume = false;
+    }
+    // Undoes push_prefix, along with anything the search left on the backtrack stack.
+    void pop_prefix() {
+        while (backtrack_stack.size()>propagated_base) {
+            deselect_row();
+        }
+        search_base = propagated_base;
+        search_resume = false;
     }
 protected:
     // This function generates the intial matrix for the problem. It may be overridden for more
@@ -303,42 +1695,51 @@ protected:
         for (int i = 0; i < array_width; i++) {
         // iterate over and initialize the header array
         // with the proper count and matrix column values
-        // set the top and bottom nodes to NULL
+        // set the top and bottom nodes to -1 (empty)
             matrix_header[i].count = get_count(i);
             matrix_header[i].matrix_column = i;
-            matrix_header[i].top = NULL;
-            matrix_header[i].bottom = NULL;
+            matrix_header[i].top = -1;
+            matrix_header[i].bottom = -1;
         }
+        // every row has num_constraints nodes, so the whole arena is a single allocation
+        matrix.resize(array_len*num_constraints);
+        node_header.resize(array_len*num_constraints);
+        node_row.resize(array_len*num_constraints);
+        row_start.resize(array_len+1);
         for (int matrix_row=0; matrix_row<array_len; matrix_row++) {
-        // iterate over the rows of the matrix, connecting them together with pointers
-        // header gets connected to the column header, right gets connected to the
-        // node to the right (or the first one if the node is the last node),
-        // left gets connected to the node to the left (or the last one if the
-        // node is the first node), matrix_row gets set to the current matrix row,
-        // top gets connected to the next node up, and bottom gets connected to the
-        // next node down
-        // if the node is the only node in the column, it is connected up and down to itself
+        // iterate over the rows of the matrix, connecting each node to its column
+        // and to the nodes to its left and right within the row
+            row_start[matrix_row] = matrix_row*num_constraints;
             for (int i=0; i<num_constraints; i++) {
-                matrix[matrix_row][i].header = &matrix_header[get_column(matrix_row,i)];
-                matrix[matrix_row][i].right = &matrix[matrix_row][(i!=num_constraints-1)?i+1:0];
-                matrix[matrix_row][i].left = &matrix[matrix_row][(i!=0)?i-1:num_constraints-1];
-                dlx_header_node* curr_header = matrix[matrix_row][i].header;
-                matrix[matrix_row][i].matrix_row = matrix_row;
-                if (curr_header->top==NULL) {
-                    curr_header->top = &matrix[matrix_row][i];
-                    curr_header->bottom = &matrix[matrix_row][i];
-                    matrix[matrix_row][i].up = &matrix[matrix_row][i];
-                    matrix[matrix_row][i].down = &matrix[matrix_row][i];
-                }
-                else {
-                    matrix[matrix_row][i].up = curr_header->bottom;
-                    matrix[matrix_row][i].down = curr_header->top;
-                    curr_header->bottom->down = &matrix[matrix_row][i];
-                    curr_header->top->up = &matrix[matrix_row][i];
-                    curr_header->bottom = &matrix[matrix_row][i];
-                }
+                link_node(matrix_row*num_constraints+i, matrix_row, get_column(matrix_row,i), matrix_row*num_constraints, num_constraints);
             }
         }
+        row_start[array_len] = array_len*num_constraints;
+    }
+    // Fills in the node at the given arena index as the constraint_num'th node of a row whose nodes start at
+    // row_first_node and are row_length long. The row is linked circularly left and right, and the node is
+    // appended to the bottom of its column (or connected up and down to itself if it is the first node there).
+    // Rows must be linked in increasing order so that node order matches row order within every column.
+    inline void link_node(int node, int matrix_row, int matrix_column, int row_first_node, int row_length) {
+        int constraint_num = node-row_first_node;
+        dlx_header_node* curr_header = &matrix_header[matrix_column];
+        node_header[node] = matrix_column;
+        node_row[node] = matrix_row;
+        matrix[node].right = row_first_node+((constraint_num!=row_length-1)?constraint_num+1:0);
+        matrix[node].left = row_first_node+((constraint_num!=0)?constraint_num-1:row_length-1);
+        if (curr_header->top==-1) {
+            curr_header->top = node;
+            curr_header->bottom = node;
+            matrix[node].up = node;
+            matrix[node].down = node;
+        }
+        else {
+            matrix[node].up = curr_header->bottom;
+            matrix[node].down = curr_header->top;
+            matrix[curr_header->bottom].down = node;
+            matrix[curr_header->top].up = node;
+            curr_header->bottom = node;
+        }
     }
     // This function is used by the generic (though inefficient) version of the generate function.
     // This function returns the initial 1 count for a column given its index.
@@ -347,10 +1748,24 @@ protected:
     // Returns the matrix column given the row number and constraint number.
     virtual int get_column(int matrix_row, int constraint_num) = 0;
     // This function sets the intitial matrix state for a given problem.
-    virtual bool initialize(input_format &data_in, set<dlx_header_node*,header_compare> &header_tree, set<dlx_header_node*,header_compare> &optional_header_tree) = 0;
-    // This function converts the backtrack stack into a solution for the problem.
+    virtual bool initialize(input_format &data_in, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) = 0;
+    // This function converts a sequence of choices (such as the backtrack stack) into a solution for the problem.
     // Returns the solution as output_format.
-    virtual output_format interpret_result(stack<pair<dlx_header_node*,dlx_matrix_node*> > backtrack_stack) = 0;
+    virtual output_format interpret_result(const vector<pair<int,int> > &choices) = 0;
+    // Writes the solution given by a sequence of choices into a flat buffer of solution_size() ints, without
+    // allocating anything.
+    virtual void decode(const vector<pair<int,int> > &choices, int* buffer) const = 0;
+    // Packs a flat solution written by decode into packed_size() zeroed bytes.
+    virtual void pack(const int* solution, unsigned char* packed) const = 0;
+    // Writes the cells of a packed solution over a flat buffer holding the solution of no choices, which gives
+    // back the flat solution it was packed from.
+    virtual void unpack(const unsigned char* packed, int* solution) const = 0;
+    // Builds the output_format of a flat solution.
+    virtual output_format unflatten(const int* solution) const = 0;
+    // Writes the part of a solution given by the row of the given node into a board built by interpret_result.
+    virtual void apply_row(output_format &board, int node) const = 0;
+    // Returns a new copy of this solver (including its current matrix state) for use by another thread.
+    virtual dlx_matrix* clone() const = 0;
     // This function prints a constraint, used for debugging.
     void virtual print_constraint(int matrix_column, int matrix_row = -1) {}
     // Saves the dimensions of the initial sparse matrix.
@@ -358,18 +1773,93 @@ protected:
     // array_width: width of the matrix
     // num_constraints: number of columns in the (non-sparse) matrix.
     int array_len, array_width, num_constraints;
-    // Sparse matrix which represents the problem.
-    vector<vector<dlx_matrix_node> > matrix;
+    // Sparse matrix which represents the problem, stored row by row in one contiguous arena of nodes.
+    vector<dlx_matrix_node> matrix;
+    // Header (matrix column) and matrix row of each node in the arena.
+    vector<int> node_header;
+    vector<int> node_row;
+    // Arena index of the first node of each row, with one extra entry marking the end of the last row.
+    vector<int> row_start;
     // Headers which represent a constraint to satisfy.
     vector<dlx_header_node> matrix_header;
     // Saves the initial state of the problem.
     input_format initial_data;
     // This indicates the starting position of optional columns (optional columns must all be to the right of mandatory columns)
     int optional_constraint_start_column = numeric_limits<int>::max();
-    // This flags turns on debug output, including timing of some components.
-    bool do_debug_output;
+    // The number of times each column may still be covered, for matrices with optional columns which may be covered
+    // more than once (empty otherwise, when every column is covered at most once). Selecting a row only covers
+    // such a column, removing its other rows, when its capacity runs out, until then the row is just taken out of
+    // it. Mandatory columns must have a capacity of 1.
+    vector<int> column_capacity;
+    // The color of each node, for matrices whose optional columns may be shared by every row which gives them the
+    // same color (exact cover with colors), and empty otherwise. A node of color 0 covers its column as usual,
+    // while selecting a row with a node of a positive color purifies the column instead of covering it, see
+    // purify. Only nodes in optional columns with a capacity of 1 may have a color.
+    vector<int> node_color;
+    // Uncovered mandatory and optional columns, kept as members so their storage is reused between solves.
+    dlx_column_index header_tree;
+    dlx_column_index optional_header_tree;
+    // The choices made by the current search as (column, node) pairs, and the number of choices at the bottom
+    // of the stack which the search may not undo.
+    vector<pair<int,int> > backtrack_stack;
+    int search_base = 0;
+    // For each choice on the backtrack stack, the row of its column which advance tries last: the one above the
+    // row chosen first, as the rows of a column are a circular list.
+    vector<int> last_rows;
+    // The number of choices at the bottom of the backtrack stack which were forced by propagate.
+    int propagated_base = 0;
+    // The mandatory columns which eliminate_dominated_rows has yet to check during propagate, and for each mandatory
+    // column whether it is among them.
+    vector<int> domination_queue;
+    vector<char> domination_queued;
+    // When set, begin_search runs propagate after initialize.
+    bool do_propagation = false;
+    // When set, the search calls prune_state on every state which is not already a dead end.
+    bool do_pruning = false;
+    // Set when the backtrack stack holds a solution that next_solution must move past before continuing.
+    bool search_resume = false;
+    // Moves made by initialize for the current search, in the order they were made.
+    vector<dlx_fixed_move> fixed_moves;
+#ifdef DEBUG
+    // The matrix as it was before the current search, which end_search checks it was restored to.
+    vector<dlx_matrix_node> pristine_matrix;
+    vector<dlx_header_node> pristine_header;
+#endif
+    // Statistics of the current search so far.
+    dlx_search_stats search_stats;
+    // How long generate took, which is copied into the stats of every search.
+    double generation_us = 0;
+    // When the current search finished initializing, from which search_us is measured.
+    chrono::steady_clock::time_point search_start;
+    // Set from when a search begins until end_search records its time.
+    bool search_timed = false;
+    // The attempt count at which limit_reached next checks the limits, which is never when there are none.
+    long long next_limit_check = numeric_limits<long long>::max();
+    // When set, called along with the limit checks, which run_parallel uses to split a worker's task while
+    // another worker is idle.
+    function<void()> share_work;
+    // State of the random sequence of a randomized search, 0 when the search uses the fixed order.
+    unsigned long long random_state = 0;
+    // The attempt count at which the current run of a search with restarts is abandoned, which is never when it
+    // has no restarts or has found a solution.
+    long long next_restart = numeric_limits<long long>::max();
+    // How many attempts a search makes between reading the clock and the cancellation flag.
+    static const int limit_check_interval = 1024;
+    // When set, every move the search makes is recorded here (the all_moves save setting).
+    move_trace* move_log = NULL;
+    // The deepest level split_search will split the search tree at.
+    int max_split_depth = 6;
 };
 
+// Builds a board of width columns and height rows (square by default) from its cells stored row by row.
+inline vector<vector<int> > dlx_grid(const int* cells, int width, int height=-1) {
+    vector<vector<int> > board(height<0?width:height);
+    for (int row = 0; row < board.size(); row++) {
+        board[row].assign(cells+row*width, cells+(row+1)*width);
+    }
+    return board;
+}
+
 /*
  * This class implements the virtual functions of the generic solver so that it may solve sudokus.
  * Inputs must be in the form of a two dimensional vector of ints, with -1 representing empty cells.
@@ -378,79 +1868,479 @@ protected:
  */
 class dlx_matrix_sudoku : public dlx_matrix<vector<vector<int> >, vector<vector<int> > > {
 public:
-    dlx_matrix_sudoku(int puzzle_width, bool do_debug=false) {
-        do_debug_output = do_debug;
+    dlx_matrix_sudoku(int puzzle_width) {
         sudoku_width = puzzle_width;
         sqrt_width = (int)sqrt(sudoku_width);
         num_constraints = 4;
         array_len = sudoku_width*sudoku_width*sudoku_width;
         array_width = sudoku_width*sudoku_width*num_constraints;
         optional_constraint_start_column = array_width;
-        matrix.resize(array_len,vector<dlx_matrix_node>(num_constraints));
         matrix_header.resize(array_width);
-        chrono::high_resolution_clock::time_point prev_time = chrono::high_resolution_clock::now();
+        do_propagation = true;
+        chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
         generate();
-        if (do_debug_output)
-            cout << "Generation took " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
+        generation_us = chrono::duration<double,micro>(chrono::steady_clock::now()-start_time).count();
+    }
+    // Deprecated, kept for callers written before the timing output moved to last_search(). do_debug is ignored,
+    // as the n-queens and polyomino solvers take no such argument.
+    dlx_matrix_sudoku(int puzzle_width, bool do_debug) : dlx_matrix_sudoku(puzzle_width) {
+    }
+    virtual int solution_size() const {
+        return sudoku_width*sudoku_width;
+    }
+    // Each cell is packed as its value less one, which is 4 bits up to 16x16.
+    virtual int packed_size() const {
+        return (sudoku_width*sudoku_width*dlx_bits_for(sudoku_width)+7)/8;
     }
 protected:
-    virtual bool initialize(vector<vector<int> > &starting_puzzle, set<dlx_header_node*,header_compare> &header_tree, set<dlx_header_node*,header_compare> &optional_header_tree) {
+    virtual dlx_matrix* clone() const {
+        return new dlx_matrix_sudoku(*this);
+    }
+    virtual bool initialize(vector<vector<int> > &starting_puzzle, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
         initial_data = starting_puzzle;
         for (int row = 0; row < starting_puzzle.size(); row++) {
             for (int col = 0; col < starting_puzzle[0].size(); col++) {
                 if (starting_puzzle[row][col]!=-1) {
-                    dlx_matrix_node* base_row_node = &matrix[(row*sudoku_width+col)*sudoku_width+starting_puzzle[row][col]-1][0];
-                    // this is a deconstructed for loop to avoid checking the condition on the first iteration (since it would be false)
-                    dlx_matrix_node* curr_row_node = base_row_node;
-                    do {
-                        if ((*header_tree.begin())->count<=0) {
-                            cout << "Input is over-constrained.\n";
-                            return false;
-                        }
-                        header_tree.erase(curr_row_node->header);
-                        remove_column(curr_row_node, header_tree, optional_header_tree);
-                        curr_row_node=curr_row_node->right;
-                    } while (curr_row_node!=base_row_node);
+                    if (!fix_row(row_start[(row*sudoku_width+col)*sudoku_width+starting_puzzle[row][col]-1])) {
+                        report("Input is over-constrained.\n");
+                        return false;
+                    }
                 }
             }
         }
         return true;
     }
-    virtual vector<vector<int> > interpret_result(stack<pair<dlx_header_node*,dlx_matrix_node*> > backtrack_stack) {
-        chrono::high_resolution_clock::time_point prev_time = chrono::high_resolution_clock::now();
+    virtual vector<vector<int> > interpret_result(const vector<pair<int,int> > &choices) {
         vector<vector<int> > solved_puzzle = initial_data;
-        while (!backtrack_stack.empty()) {
-            int matrix_column = matrix[backtrack_stack.top().second->matrix_row][0].header->matrix_column;
-            int matrix_row = backtrack_stack.top().second->matrix_row;
-            solved_puzzle[matrix_column%(sudoku_width*sudoku_width)/sudoku_width][matrix_column%(sudoku_width*sudoku_width)%sudoku_width] = matrix_row%sudoku_width+1;
-            backtrack_stack.pop();
-        }
-        if (do_debug_output)
-            cout << "Interpretation took " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
+        for (int i = 0; i < choices.size(); i++) {
+            apply_row(solved_puzzle, choices[i].second);
+        }
         return solved_puzzle;
     }
+    virtual void apply_row(vector<vector<int> > &board, int node) const {
+        int matrix_row = node_row[node];
+        int matrix_column = node_header[row_start[matrix_row]];
+        board[matrix_column%(sudoku_width*sudoku_width)/sudoku_width][matrix_column%(sudoku_width*sudoku_width)%sudoku_width] = matrix_row%sudoku_width+1;
+    }
+    virtual void decode(const vector<pair<int,int> > &choices, int* buffer) const {
+        for (int row = 0; row < sudoku_width; row++) {
+            copy(initial_data[row].begin(), initial_data[row].end(), buffer+row*sudoku_width);
+        }
+        for (int i = 0; i < choices.size(); i++) {
+            int matrix_row = node_row[choices[i].second];
+            buffer[node_header[row_start[matrix_row]]%(sudoku_width*sudoku_width)] = matrix_row%sudoku_width+1;
+        }
+    }
+    virtual void pack(const int* solution, unsigned char* packed) const {
+        int bits = dlx_bits_for(sudoku_width);
+        for (int cell = 0; cell < sudoku_width*sudoku_width; cell++) {
+            dlx_pack_bits(packed, cell, bits, solution[cell]-1);
+        }
+    }
+    virtual void unpack(const unsigned char* packed, int* solution) const {
+        int bits = dlx_bits_for(sudoku_width);
+        for (int cell = 0; cell < sudoku_width*sudoku_width; cell++) {
+            solution[cell] = dlx_unpack_bits(packed, cell, bits)+1;
+        }
+    }
+    virtual vector<vector<int> > unflatten(const int* solution) const {
+        return dlx_grid(solution, sudoku_width);
+    }
     virtual int get_count(int matrix_column) {
         return sudoku_width;
     }
-    virtual int get_column(int matrix_row, int constraint_num) {
-        int row_num = matrix_row/sudoku_width/sudoku_width;
-        int col_num = matrix_row/sudoku_width%sudoku_width;
-        int curr_num = matrix_row%sudoku_width;
-        switch (constraint_num) {
-            case 0:
-                return row_num*sudoku_width+col_num;
-            case 1:
-                return row_num*sudoku_width+curr_num+sudoku_width*sudoku_width;
-            case 2:
-                return col_num*sudoku_width+curr_num+sudoku_width*sudoku_width*2;
-            case 3:
-                return (row_num/sqrt_width*sqrt_width+col_num/sqrt_width)*sudoku_width+curr_num+sudoku_width*sudoku_width*3;
-            default: return -1;
+    virtual int get_column(int matrix_row, int constraint_num) {
+        int row_num = matrix_row/sudoku_width/sudoku_width;
+        int col_num = matrix_row/sudoku_width%sudoku_width;
+        int curr_num = matrix_row%sudoku_width;
+        switch (constraint_num) {
+            case 0:
+                return row_num*sudoku_width+col_num;
+            case 1:
+                return row_num*sudoku_width+curr_num+sudoku_width*sudoku_width;
+            case 2:
+                return col_num*sudoku_width+curr_num+sudoku_width*sudoku_width*2;
+            case 3:
+                return (row_num/sqrt_width*sqrt_width+col_num/sqrt_width)*sudoku_width+curr_num+sudoku_width*sudoku_width*3;
+            default: return -1;
+        }
+    }
+private:
+    int sudoku_width;
+    int sqrt_width; 
+};
+
+// Integer square root (rounded down) which can be evaluated at compile time.
+constexpr int dlx_int_sqrt(int n, int root=0) {
+    return ((root+1)*(root+1)>n)?root:dlx_int_sqrt(n,root+1);
+}
+
+/*
+ * This class is the same sudoku solver as dlx_matrix_sudoku, except that the puzzle width is a template parameter.
+ * All of the column, count and decoding arithmetic is then done with constants, the matrix is generated
+ * without any virtual calls, and the class is final so that calls on it directly need no virtual dispatch.
+ * The search itself makes no virtual calls per node; initialize, interpret_result and decode are still reached
+ * through the base class, but only once per search or solution.
+ * It should be used for the common sizes, with dlx_matrix_sudoku left for widths only known at runtime.
+ */
+template <int N>
+class dlx_matrix_sudoku_static final : public dlx_matrix<vector<vector<int> >, vector<vector<int> > > {
+public:
+    static_assert(N>0&&dlx_int_sqrt(N)*dlx_int_sqrt(N)==N, "The sudoku width must be a square.");
+    dlx_matrix_sudoku_static() {
+        num_constraints = 4;
+        array_len = N*N*N;
+        array_width = N*N*num_constraints;
+        optional_constraint_start_column = array_width;
+        matrix_header.resize(array_width);
+        do_propagation = true;
+        chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+        generate();
+        generation_us = chrono::duration<double,micro>(chrono::steady_clock::now()-start_time).count();
+    }
+    // Returns the matrix column of a constraint of a matrix row (the value matrix_row%N+1 in cell matrix_row/N).
+    static constexpr int column(int matrix_row, int constraint_num) {
+        return (constraint_num==0)?matrix_row/N:
+               (constraint_num==1)?matrix_row/(N*N)*N+matrix_row%N+N*N:
+               (constraint_num==2)?matrix_row/N%N*N+matrix_row%N+N*N*2:
+               (matrix_row/(N*N)/sqrt_width*sqrt_width+matrix_row/N%N/sqrt_width)*N+matrix_row%N+N*N*3;
+    }
+    virtual int solution_size() const {
+        return N*N;
+    }
+    virtual int packed_size() const {
+        return (N*N*value_bits+7)/8;
+    }
+protected:
+    static constexpr int sqrt_width = dlx_int_sqrt(N);
+    static constexpr int value_bits = dlx_bits_for(N);
+    virtual dlx_matrix* clone() const {
+        return new dlx_matrix_sudoku_static(*this);
+    }
+    virtual void generate() {
+        for (int i = 0; i < N*N*4; i++) {
+            matrix_header[i].count = N;
+            matrix_header[i].matrix_column = i;
+            matrix_header[i].top = -1;
+            matrix_header[i].bottom = -1;
+        }
+        matrix.resize(N*N*N*4);
+        node_header.resize(N*N*N*4);
+        node_row.resize(N*N*N*4);
+        row_start.resize(N*N*N+1);
+        for (int matrix_row = 0; matrix_row < N*N*N; matrix_row++) {
+            row_start[matrix_row] = matrix_row*4;
+            for (int i = 0; i < 4; i++) {
+                link_node(matrix_row*4+i, matrix_row, column(matrix_row,i), matrix_row*4, 4);
+            }
+        }
+        row_start[N*N*N] = N*N*N*4;
+    }
+    virtual bool initialize(vector<vector<int> > &starting_puzzle, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        if (starting_puzzle.size()!=N) {
+            report("Input is not "+to_string(N)+" by "+to_string(N)+".\n");
+            return false;
+        }
+        initial_data = starting_puzzle;
+        for (int row = 0; row < N; row++) {
+            if (starting_puzzle[row].size()!=N) {
+                report("Input is not "+to_string(N)+" by "+to_string(N)+".\n");
+                return false;
+            }
+            for (int col = 0; col < N; col++) {
+                if (starting_puzzle[row][col]!=-1) {
+                    if (starting_puzzle[row][col]<1||starting_puzzle[row][col]>N) {
+                        report("Input has a value outside 1 to "+to_string(N)+".\n");
+                        return false;
+                    }
+                    if (!fix_row(row_start[(row*N+col)*N+starting_puzzle[row][col]-1])) {
+                        report("Input is over-constrained.\n");
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+    virtual vector<vector<int> > interpret_result(const vector<pair<int,int> > &choices) {
+        vector<vector<int> > solved_puzzle = initial_data;
+        for (int i = 0; i < choices.size(); i++) {
+            apply_row(solved_puzzle, choices[i].second);
+        }
+        return solved_puzzle;
+    }
+    virtual void apply_row(vector<vector<int> > &board, int node) const {
+        int matrix_row = node_row[node];
+        board[matrix_row/(N*N)][matrix_row/N%N] = matrix_row%N+1;
+    }
+    virtual void decode(const vector<pair<int,int> > &choices, int* buffer) const {
+        for (int row = 0; row < N; row++) {
+            copy(initial_data[row].begin(), initial_data[row].end(), buffer+row*N);
+        }
+        for (int i = 0; i < choices.size(); i++) {
+            int matrix_row = node_row[choices[i].second];
+            buffer[matrix_row/N] = matrix_row%N+1;
+        }
+    }
+    virtual void pack(const int* solution, unsigned char* packed) const {
+        for (int cell = 0; cell < N*N; cell++) {
+            dlx_pack_bits(packed, cell, value_bits, solution[cell]-1);
+        }
+    }
+    virtual void unpack(const unsigned char* packed, int* solution) const {
+        for (int cell = 0; cell < N*N; cell++) {
+            solution[cell] = dlx_unpack_bits(packed, cell, value_bits)+1;
+        }
+    }
+    virtual vector<vector<int> > unflatten(const int* solution) const {
+        return dlx_grid(solution, N);
+    }
+    virtual int get_count(int matrix_column) {
+        return N;
+    }
+    virtual int get_column(int matrix_row, int constraint_num) {
+        return column(matrix_row,constraint_num);
+    }
+};
+
+// Returns a new sudoku solver for the given width, using the compile-time specialized solver for the common
+// sizes and dlx_matrix_sudoku for any other width.
+inline dlx_matrix<vector<vector<int> >, vector<vector<int> > >* new_dlx_matrix_sudoku(int puzzle_width) {
+    switch (puzzle_width) {
+        case 4:
+            return new dlx_matrix_sudoku_static<4>();
+        case 9:
+            return new dlx_matrix_sudoku_static<9>();
+        case 16:
+            return new dlx_matrix_sudoku_static<16>();
+        default:
+            return new dlx_matrix_sudoku(puzzle_width);
+    }
+}
+
+/*
+ * This class solves batches of sudokus on a pool of worker threads. Each worker owns one pre-generated
+ * sudoku solver (from new_dlx_matrix_sudoku) for every puzzle width it has seen, which it reuses for every puzzle of that width, so
+ * a batch may freely mix sizes (4x4, 9x9, 16x16, ...) and no matrix is generated while the batch is timed.
+ */
+class dlx_sudoku_batch {
+public:
+    typedef dlx_matrix<vector<vector<int> >, vector<vector<int> > > sudoku_solver;
+    // The solutions to a batch, in the same order as the input boards, with timing for the batch.
+    // A board which has no solution or is not a valid sudoku gets an empty solution, and its outcome says which.
+    // Nothing is printed for such boards, as the workers' solvers are quiet.
+    struct batch_result {
+        vector<vector<vector<int> > > solutions;
+        vector<dlx_batch_outcome> outcomes;
+        // Puzzles solved per second of wall clock time over the whole batch.
+        double puzzles_per_second = 0;
+        // Median and 99th percentile time to solve a single puzzle, in microseconds.
+        double p50_latency_us = 0;
+        double p99_latency_us = 0;
+    };
+    // num_threads: number of worker threads, or 0 to use one per hardware thread.
+    dlx_sudoku_batch(int num_threads_in=0) {
+        num_threads = (num_threads_in>0)?num_threads_in:max((int)thread::hardware_concurrency(),1);
+    }
+    // Generates a solver of the given width for every worker ahead of time. This is done automatically
+    // for any new width in a batch, but calling it beforehand keeps the generation out of the first batch.
+    void reserve(int puzzle_width) {
+        vector<unique_ptr<sudoku_solver> > &pool = solver_pools[puzzle_width];
+        while (pool.size()<num_threads) {
+            pool.push_back(unique_ptr<sudoku_solver>(new_dlx_matrix_sudoku(puzzle_width)));
+            pool.back()->quiet = true;
+        }
+    }
+    // Solves num_boards boards starting at boards, returning the first solution found for each.
+    batch_result solve(const vector<vector<int> >* boards, int num_boards) {
+        batch_result result;
+        result.solutions.resize(num_boards);
+        result.outcomes.assign(num_boards,dlx_batch_outcome::invalid);
+        vector<double> latencies(num_boards,0);
+        vector<bool> valid(num_boards);
+        for (int i = 0; i < num_boards; i++) {
+            valid[i] = is_valid(boards[i]);
+            if (valid[i]) {
+                reserve(boards[i].size());
+            }
+        }
+        // boards are handed out in input order, one at a time, so a slow puzzle never holds up a whole chunk
+        atomic<int> next_board(0);
+        // the pools are only read while the workers run
+        const map<int,vector<unique_ptr<sudoku_solver> > > &pools = solver_pools;
+        chrono::steady_clock::time_point batch_start = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (int worker_num = 0; worker_num < num_threads; worker_num++) {
+            threads.push_back(thread([&,worker_num]() {
+                for (int i = next_board.fetch_add(1); i < num_boards; i = next_board.fetch_add(1)) {
+                    if (!valid[i]) {
+                        continue;
+                    }
+                    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    sudoku_solver &solver = *pools.at(boards[i].size())[worker_num];
+                    vector<vector<vector<int> > > solutions = solver.solve(boards[i],1);
+                    latencies[i] = chrono::duration<double,micro>(chrono::steady_clock::now()-start).count();
+                    if (!solutions.empty()) {
+                        result.solutions[i].swap(solutions[0]);
+                        result.outcomes[i] = dlx_batch_outcome::solved;
+                    }
+                    else if (solver.last_search().status!=dlx_search_status::invalid_input) {
+                        result.outcomes[i] = dlx_batch_outcome::no_solution;
+                    }
+                }
+            }));
+        }
+        for (int i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        double batch_seconds = chrono::duration<double>(chrono::steady_clock::now()-batch_start).count();
+        if (num_boards>0&&batch_seconds>0) {
+            result.puzzles_per_second = num_boards/batch_seconds;
+        }
+        // invalid boards are never solved, so they are left out of the latencies
+        vector<double> solved_latencies;
+        for (int i = 0; i < num_boards; i++) {
+            if (valid[i]) {
+                solved_latencies.push_back(latencies[i]);
+            }
+        }
+        if (!solved_latencies.empty()) {
+            result.p50_latency_us = percentile(solved_latencies,0.50);
+            result.p99_latency_us = percentile(solved_latencies,0.99);
+        }
+        return result;
+    }
+    inline batch_result solve(const vector<vector<vector<int> > > &boards) {
+        return solve(boards.data(),boards.size());
+    }
+private:
+    // Checks that a board is square, its width is a square, and every cell is -1 or a value from 1 to the width.
+    static bool is_valid(const vector<vector<int> > &board) {
+        int width = board.size();
+        int sqrt_width = (int)round(sqrt(width));
+        if (width==0||sqrt_width*sqrt_width!=width) {
+            return false;
+        }
+        for (int row = 0; row < width; row++) {
+            if (board[row].size()!=width) {
+                return false;
+            }
+            for (int col = 0; col < width; col++) {
+                if (board[row][col]!=-1&&(board[row][col]<1||board[row][col]>width)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    // Returns the nearest-rank percentile (fraction from 0 to 1) of the given values, which are partially reordered.
+    static double percentile(vector<double> &values, double fraction) {
+        int rank = max((int)ceil(fraction*values.size())-1,0);
+        nth_element(values.begin(),values.begin()+rank,values.end());
+        return values[rank];
+    }
+    int num_threads;
+    // One pool of solvers per puzzle width, holding a solver for each worker thread.
+    map<int,vector<unique_ptr<sudoku_solver> > > solver_pools;
+};
+
+/*
+ * This class generates random sudokus with a unique solution on a pool of worker threads, each of which owns a
+ * reusable solver for every puzzle width as in dlx_sudoku_batch. A puzzle starts as a random full grid, found by a
+ * randomized search on the empty board, and its clues are then removed in a random order, each removal being kept
+ * only if the puzzle still has a unique solution (checked with verify_unique, which stops at a second solution).
+ * A full pass leaves a minimal puzzle, from which no clue can be removed, since removing clues never makes another
+ * clue unnecessary. Puzzle i of a call only depends on the seed and i, so the output does not depend on the
+ * number of threads.
+ */
+class dlx_sudoku_generator {
+public:
+    typedef dlx_matrix<vector<vector<int> >, vector<vector<int> > > sudoku_solver;
+    // A generated puzzle, with -1 for empty cells, along with its solution and its number of clues.
+    struct generated_puzzle {
+        vector<vector<int> > puzzle;
+        vector<vector<int> > solution;
+        int clues = 0;
+    };
+    // The puzzles generated by a call, in order, with the throughput of the call.
+    struct generator_result {
+        vector<generated_puzzle> puzzles;
+        // Puzzles generated per second of wall clock time.
+        double puzzles_per_second = 0;
+    };
+    // num_threads: number of worker threads, or 0 to use one per hardware thread.
+    dlx_sudoku_generator(int num_threads_in=0) {
+        num_threads = (num_threads_in>0)?num_threads_in:max((int)thread::hardware_concurrency(),1);
+    }
+    // Generates a solver of the given width for every worker ahead of time, as dlx_sudoku_batch::reserve does.
+    void reserve(int puzzle_width) {
+        vector<unique_ptr<sudoku_solver> > &pool = solver_pools[puzzle_width];
+        while (pool.size()<num_threads) {
+            pool.push_back(unique_ptr<sudoku_solver>(new_dlx_matrix_sudoku(puzzle_width)));
+            pool.back()->quiet = true;
+        }
+    }
+    // Generates num_puzzles puzzles of the given width, which must be a square. Clues are removed until the puzzle
+    // is minimal, or until it has target_clues clues if that comes first (so 0 always gives minimal puzzles).
+    generator_result generate(int puzzle_width, int num_puzzles, unsigned long long seed=1, int target_clues=0) {
+        generator_result result;
+        result.puzzles.resize(num_puzzles);
+        reserve(puzzle_width);
+        atomic<int> next_puzzle(0);
+        vector<unique_ptr<sudoku_solver> > &pool = solver_pools[puzzle_width];
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (int worker_num = 0; worker_num < num_threads; worker_num++) {
+            threads.push_back(thread([&,worker_num]() {
+                for (int i = next_puzzle.fetch_add(1); i < num_puzzles; i = next_puzzle.fetch_add(1)) {
+                    result.puzzles[i] = generate_puzzle(*pool[worker_num], puzzle_width, seed*0x9E3779B97F4A7C15ULL+i, target_clues);
+                }
+            }));
         }
+        for (int i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+        if (num_puzzles>0&&seconds>0) {
+            result.puzzles_per_second = num_puzzles/seconds;
+        }
+        return result;
     }
 private:
-    int sudoku_width;
-    int sqrt_width; 
+    // Generates one puzzle with the given solver, using a random sequence seeded by puzzle_seed.
+    static generated_puzzle generate_puzzle(sudoku_solver &solver, int width, unsigned long long puzzle_seed, int target_clues) {
+        mt19937_64 random(puzzle_seed);
+        generated_puzzle result;
+        // any solution of the empty board is a full grid, and the restarts keep a bad random order from stalling
+        solver.randomization.seed = random()|1;
+        solver.randomization.restarts = dlx_restart_schedule::luby;
+        result.solution = solver.solve(vector<vector<int> >(width,vector<int>(width,-1)),1)[0];
+        solver.randomization = dlx_search_randomization();
+        result.puzzle = result.solution;
+        result.clues = width*width;
+        vector<int> cells(width*width);
+        for (int i = 0; i < cells.size(); i++) {
+            cells[i] = i;
+        }
+        for (int i = cells.size()-1; i > 0; i--) {
+            swap(cells[i],cells[random()%(i+1)]);
+        }
+        for (int i = 0; i < cells.size() && result.clues>target_clues; i++) {
+            int &cell = result.puzzle[cells[i]/width][cells[i]%width];
+            int value = cell;
+            cell = -1;
+            if (solver.verify_unique(result.puzzle)==dlx_uniqueness::unique) {
+                result.clues--;
+            }
+            else {
+                cell = value;
+            }
+        }
+        return result;
+    }
+    int num_threads;
+    // One pool of solvers per puzzle width, holding a solver for each worker thread.
+    map<int,vector<unique_ptr<sudoku_solver> > > solver_pools;
 };
 
 /*
@@ -467,36 +2357,102 @@ public:
         array_len = board_width*board_width;
         array_width = board_width*num_mandatory_constraints+(board_width*2-1)*num_optional_constraints;
         optional_constraint_start_column = board_width*num_mandatory_constraints;
-        matrix.resize(array_len,vector<dlx_matrix_node>(num_constraints));
         matrix_header.resize(array_width);
-        chrono::high_resolution_clock::time_point prev_time = chrono::high_resolution_clock::now();
+        chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
         generate();
-        cout << "Generation took " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
+        generation_us = chrono::duration<double,micro>(chrono::steady_clock::now()-start_time).count();
+    }
+    virtual int solution_size() const {
+        return board_width*board_width;
+    }
+    // There is a queen on every row, so a solution is packed as the column of each row's queen.
+    virtual int packed_size() const {
+        return (board_width*dlx_bits_for(board_width)+7)/8;
+    }
+    // The number of solutions on the empty board, and the number of them which are distinct up to the 8
+    // rotations and reflections of the board.
+    struct symmetry_counts {
+        unsigned long long total = 0;
+        unsigned long long distinct = 0;
+    };
+    // Calls on_solution with one solution of every class of solutions on the empty board which are equivalent
+    // under rotation and reflection, until it returns false, and returns the number of classes passed. Each
+    // solution is given as the column of the queen in each row, and is the least of its class in that order,
+    // along with the number of solutions in its class (2, 4 or 8).
+    // The least solution of a class has its first queen at some column k in the left half of the first row, and
+    // since every rotation and reflection of it starts with the distance of a queen on an edge of the board from
+    // one of that edge's corners, no queen on an edge is closer than k to a corner. So the search is run once for
+    // each k with the first queen fixed and those cells removed, which visits about an eighth of the solutions,
+    // and only the visited solutions which are the least of their class are kept.
+    unsigned long long for_each_distinct(const function<bool(const vector<int>&, int)> &on_solution) {
+        vector<dlx_search_stats> runs;
+        vector<int> queens(board_width);
+        vector<vector<int> > empty_board;
+        unsigned long long class_count = 0;
+        bool stopped = false;
+        for (int first_column = 0; first_column <= (board_width-1)/2 && !stopped; first_column++) {
+            symmetry_first_column = first_column;
+            bool initialized = begin_search(empty_board);
+            symmetry_first_column = -1;
+            while (initialized && !stopped && next_solution()) {
+                queens[0] = first_column;
+                for (int i = 0; i < backtrack_stack.size(); i++) {
+                    int matrix_row = node_row[backtrack_stack[i].second];
+                    queens[matrix_row/board_width] = matrix_row%board_width;
+                }
+                int class_size = symmetry_class_size(queens);
+                if (class_size>0) {
+                    class_count++;
+                    stopped = !on_solution(queens, class_size);
+                }
+            }
+            end_search();
+            runs.push_back(search_stats);
+            stopped = stopped || search_stats.status!=dlx_search_status::completed;
+        }
+        search_stats = dlx_search_stats();
+        search_stats.generation_us = generation_us;
+        for (int i = 0; i < runs.size(); i++) {
+            add_worker_stats(runs[i]);
+            search_stats.initialize_us += runs[i].initialize_us;
+            search_stats.search_us += runs[i].search_us;
+        }
+        search_stats.solutions = class_count;
+        return class_count;
+    }
+    // Counts the solutions on the empty board, in total and up to symmetry, using for_each_distinct.
+    symmetry_counts count_distinct() {
+        symmetry_counts counts;
+        for_each_distinct([&counts](const vector<int> &queens, int class_size) {
+            counts.distinct++;
+            counts.total += class_size;
+            return true;
+        });
+        return counts;
     }
 protected:
-    virtual bool initialize(vector<vector<int> > &starting_puzzle, set<dlx_header_node*,header_compare> &header_tree, set<dlx_header_node*,header_compare> &optional_header_tree) {
+    virtual dlx_matrix* clone() const {
+        return new dlx_matrix_n_queens(*this);
+    }
+    virtual bool initialize(vector<vector<int> > &starting_puzzle, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
         //print_headers(header_tree);
         initial_data = starting_puzzle;
+        if (symmetry_first_column!=-1) {
+            return initialize_symmetric();
+        }
         for (int row = 0; row < starting_puzzle.size(); row++) {
             for (int col = 0; col < starting_puzzle[0].size(); col++) {
                 if (starting_puzzle[row][col]!=0) {
-                    dlx_matrix_node* base_row_node = &matrix[row*board_width+col][0];
-                    do {
-                        if ((*header_tree.begin())->count<=0) {
-                            cout << "Input is over-constrained.\n";
-                            return false;
-                        }
-                        header_tree.erase(base_row_node->header);
-                        remove_column(base_row_node, header_tree,optional_header_tree);
-                        base_row_node=base_row_node->right;
-                    } while (base_row_node!=&matrix[row*board_width+col][0]);
+                    if (!fix_row(row_start[row*board_width+col])) {
+                        report("Input is over-constrained.\n");
+                        return false;
+                    }
                 }
             }
         }
         return true;
     }
-    virtual vector<vector<int> > interpret_result(stack<pair<dlx_header_node*,dlx_matrix_node*> > backtrack_stack) {
-        chrono::high_resolution_clock::time_point prev_time = chrono::high_resolution_clock::now();
+    virtual vector<vector<int> > interpret_result(const vector<pair<int,int> > &choices) {
         vector<vector<int> > result;
         if (initial_data!=vector<vector<int> >()) {
             result = initial_data;
@@ -504,15 +2460,96 @@ protected:
         else {
             result = vector<vector<int> >(board_width,vector<int>(board_width));
         }
-        while (!backtrack_stack.empty()) {
-            int matrix_column = matrix[backtrack_stack.top().second->matrix_row][0].header->matrix_column;
-            int matrix_row = backtrack_stack.top().second->matrix_row;
-            result[matrix_row/board_width][matrix_row%board_width] = 1;
-            backtrack_stack.pop();
+        for (int i = 0; i < choices.size(); i++) {
+            apply_row(result, choices[i].second);
         }
-        cout << "Interpretation took " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
         return result;
     }
+    virtual void apply_row(vector<vector<int> > &board, int node) const {
+        int matrix_row = node_row[node];
+        board[matrix_row/board_width][matrix_row%board_width] = 1;
+    }
+    virtual void decode(const vector<pair<int,int> > &choices, int* buffer) const {
+        if (initial_data!=vector<vector<int> >()) {
+            for (int row = 0; row < board_width; row++) {
+                copy(initial_data[row].begin(), initial_data[row].end(), buffer+row*board_width);
+            }
+        }
+        else {
+            fill(buffer, buffer+board_width*board_width, 0);
+        }
+        for (int i = 0; i < choices.size(); i++) {
+            buffer[node_row[choices[i].second]] = 1;
+        }
+    }
+    virtual void pack(const int* solution, unsigned char* packed) const {
+        int bits = dlx_bits_for(board_width);
+        for (int row = 0; row < board_width; row++) {
+            int col = 0;
+            while (solution[row*board_width+col]==0) {
+                col++;
+            }
+            dlx_pack_bits(packed, row, bits, col);
+        }
+    }
+    virtual void unpack(const unsigned char* packed, int* solution) const {
+        int bits = dlx_bits_for(board_width);
+        for (int row = 0; row < board_width; row++) {
+            int cell = row*board_width+dlx_unpack_bits(packed, row, bits);
+            // queens given in the input already hold their own value
+            if (solution[cell]==0) {
+                solution[cell] = 1;
+            }
+        }
+    }
+    virtual vector<vector<int> > unflatten(const int* solution) const {
+        return dlx_grid(solution, board_width);
+    }
+    // Sets up the search of for_each_distinct for the first queen at symmetry_first_column: every cell on an
+    // edge closer to a corner than that is removed, then the first queen is placed.
+    bool initialize_symmetric() {
+        int first_column = symmetry_first_column;
+        int last = board_width-1;
+        vector<char> removed(board_width*board_width,0);
+        for (int i = 0; i < board_width; i++) {
+            if (i<first_column||i>last-first_column) {
+                removed[i] = removed[last*board_width+i] = removed[i*board_width] = removed[i*board_width+last] = 1;
+            }
+        }
+        removed[first_column] = 0;
+        for (int cell = 0; cell < board_width*board_width; cell++) {
+            if (removed[cell]) {
+                eliminate_row(row_start[cell]);
+            }
+        }
+        return fix_row(row_start[first_column]);
+    }
+    // Returns the number of solutions in the class of the given solution (the columns of its queens by row) under
+    // the rotations and reflections of the board, or 0 if another solution in the class is less than it.
+    int symmetry_class_size(const vector<int> &queens) {
+        int last = board_width-1;
+        queen_rows.resize(board_width);
+        for (int row = 0; row < board_width; row++) {
+            queen_rows[queens[row]] = row;
+        }
+        int symmetric_count = 0;
+        for (int symmetry = 0; symmetry < 8; symmetry++) {
+            // the first four are the solution reflected about the middle column and row, the others are those of
+            // the solution reflected about its diagonal, which swaps rows and columns
+            const vector<int> &lines = (symmetry<4)?queens:queen_rows;
+            int order = 0;
+            for (int row = 0; row < board_width && order==0; row++) {
+                int source_row = (symmetry&2)?last-row:row;
+                int column = (symmetry&1)?last-lines[source_row]:lines[source_row];
+                order = (column<queens[row])?-1:(column>queens[row])?1:0;
+            }
+            if (order<0) {
+                return 0;
+            }
+            symmetric_count += order==0;
+        }
+        return 8/symmetric_count;
+    }
     virtual int get_count(int matrix_column) {
         if (matrix_column<board_width*2) {
             return board_width;
@@ -541,95 +2578,79 @@ protected:
     }
 private:
     int board_width;
+    // The first queen's column while for_each_distinct initializes a search, otherwise -1.
+    int symmetry_first_column = -1;
+    // The row of the queen in each column, used by symmetry_class_size.
+    vector<int> queen_rows;
     int num_mandatory_constraints;
     int num_optional_constraints;
 };
 
-struct set_polyomino_compare {
-    inline bool operator() (const set<pair<int,int> > l, const set<pair<int,int> > r) const {
-        if (l.size()!=r.size()) {
-            return l.size()<r.size();
-        }
-        for (set<pair<int,int> >::iterator l_iter = l.begin(), r_iter = r.begin(); l_iter!=l.end()&&r_iter!=r.end(); l_iter++,r_iter++) { //technically r_iter!=r.end() should happen when l_iter!=l.end() since we confirmed that they are the same size
-            if (*l_iter!=*r_iter) {
-                return *l_iter<*r_iter;
-            }
-        }
-        return false;
-    }
-};
-
 class polyomino {
 public:
     polyomino(vector<pair<int,int> > block_positions) {
         size = block_positions.size();
         x_len = 0;
         y_len = 0;
-        for (int i = 0; i<block_positions.size(); i++) {
+        int min_x = size>0?block_positions[0].first:0;
+        int min_y = size>0?block_positions[0].second:0;
+        for (int i = 0; i < block_positions.size(); i++) {
             if (block_positions[i].first<0||block_positions[i].second<0) {
                 cout << "Negative positions are not allowed, as all positions should relative to a square where the upper left is (0,0).\n";
                 exit(1);
             }
             else {
-                if (block_positions[i].first>x_len) {
-                    x_len = block_positions[i].first;
-                }
-                if (block_positions[i].second>y_len) {
-                    y_len = block_positions[i].second;
-                }
-            }
-        }
-        set<set<pair<int,int> >, set_polyomino_compare> shape_set;
-        vector<set<set<pair<int,int> >, set_polyomino_compare>::iterator> flipped_orientation(4); //max 4 orientations which differ in dimension from the original
-        set<pair<int,int> > last_rotation(block_positions.begin(),block_positions.end());
-        shape_set.insert(last_rotation);
-        set<pair<int,int> > current_rotation;
-        for (int i=0; i<3; i++) { //log each rotation
-            current_rotation.clear();
-            for (set<pair<int,int> >::iterator last_iter = last_rotation.begin(); last_iter!=last_rotation.end(); last_iter++) {
-                current_rotation.insert(pair<int,int>(last_iter->second,((i&1)==1?y_len:x_len)-last_iter->first));
-            }
-            if ((i&1)==0) { // if the number is even
-                flipped_orientation[i/2] = shape_set.insert(current_rotation).first;
-            }
-            else {
-                shape_set.insert(current_rotation);
+                min_x = min(min_x, block_positions[i].first);
+                min_y = min(min_y, block_positions[i].second);
             }
-            last_rotation.swap(current_rotation);
         }
-        last_rotation.clear();
-        for (int i = 0; i < size; i++) {
-            last_rotation.insert(pair<int,int>(block_positions[i].first,y_len-block_positions[i].second));
+        // the shape is moved to touch both axes, so that no two orientations are translations of each other
+        for (int i = 0; i < block_positions.size(); i++) {
+            block_positions[i].first -= min_x;
+            block_positions[i].second -= min_y;
+            x_len = max(x_len, block_positions[i].first);
+            y_len = max(y_len, block_positions[i].second);
         }
-        shape_set.insert(last_rotation);
-        for (int i=0; i<3; i++) { //log each rotation
-            current_rotation.clear();
-            for (set<pair<int,int> >::iterator last_iter = last_rotation.begin(); last_iter!=last_rotation.end(); last_iter++) {
-                current_rotation.insert(pair<int,int>(last_iter->second,((i&1)==1?y_len:x_len)-last_iter->first));
-            }
-            if ((i&1)==0) { // if the number is even
-                flipped_orientation[i/2+2] = shape_set.insert(current_rotation).first;
-            }
-            else {
-                shape_set.insert(current_rotation);
+        // Each of the eight rotations and reflections of the shape is kept as the sorted codes x*code_base+y of its
+        // blocks, which sort in the same order as the blocks, so sorting the arrays puts equal orientations next to
+        // each other and orders the distinct ones by their blocks. Bit 2 of a transform swaps x and y, which is what
+        // makes an orientation flipped (its dimensions swapped), then bits 0 and 1 reflect it in x and y.
+        int code_base = max(x_len,y_len)+1;
+        vector<pair<vector<int>,char> > transformed(8, pair<vector<int>,char>(vector<int>(size),0));
+        for (int transform = 0; transform < 8; transform++) {
+            bool swap_axes = (transform&4)!=0;
+            int new_x_len = swap_axes?y_len:x_len;
+            int new_y_len = swap_axes?x_len:y_len;
+            for (int i = 0; i < size; i++) {
+                int x = swap_axes?block_positions[i].second:block_positions[i].first;
+                int y = swap_axes?block_positions[i].first:block_positions[i].second;
+                if (transform&1) {
+                    x = new_x_len-x;
+                }
+                if (transform&2) {
+                    y = new_y_len-y;
+                }
+                transformed[transform].first[i] = x*code_base+y;
             }
-            last_rotation.swap(current_rotation);
+            sort(transformed[transform].first.begin(), transformed[transform].first.end());
+            transformed[transform].second = swap_axes;
         }
-        orientations = shape_set.size();
-        shapes.resize(orientations);
-        flipped.resize(orientations,false);
-        int filled_size = 0;
-        for (set<set<pair<int,int> >, set_polyomino_compare>::iterator shape_iter = shape_set.begin(); shape_iter!=shape_set.end(); shape_iter++, filled_size++) {
+        sort(transformed.begin(), transformed.end());
+        shapes.clear();
+        flipped.clear();
+        for (int transform = 0; transform < 8; transform++) {
+            if (transform>0&&transformed[transform].first==transformed[transform-1].first) {
+                flipped.back() = flipped.back()||transformed[transform].second;
+                continue;
+            }
             vector<pair<int,int> > curr_shape(size);
-            copy(shape_iter->begin(),shape_iter->end(),curr_shape.begin());
-            shapes[filled_size] = curr_shape;
-            for (int i = 0; i < 4; i++) {
-                if (flipped_orientation[i]==shape_iter) {
-                    flipped[filled_size] = true;
-                    break;
-                }
+            for (int i = 0; i < size; i++) {
+                curr_shape[i] = pair<int,int>(transformed[transform].first[i]/code_base,transformed[transform].first[i]%code_base);
             }
+            shapes.push_back(curr_shape);
+            flipped.push_back(transformed[transform].second);
         }
+        orientations = shapes.size();
         //for the duration of these code these were end indices, rather than lengths. Thus, to become lengths, they must be iterated by one
         x_len++;
         y_len++;
@@ -685,130 +2706,452 @@ private:
 
 class dlx_matrix_polyomino : public dlx_matrix<vector<vector<int> >, vector<vector<int> > > {
 public:
-    dlx_matrix_polyomino(vector<polyomino> polyomino_list_in,int board_width_in) {
+    dlx_matrix_polyomino(vector<polyomino> polyomino_list_in,int board_width_in) : dlx_matrix_polyomino(polyomino_list_in, board_width_in, board_width_in) {
+    }
+    // Tiles a board of board_width_in columns and board_height_in rows, using polyomino i piece_counts_in[i] times
+    // (or every polyomino once if no counts are given). A polyomino used once has a mandatory column as before, but
+    // the copies of a polyomino used more than once share an optional column which may be covered that many times,
+    // so that each tiling is found once rather than once for every ordering of the copies. Such a column only
+    // stops the copies being used too often, so every copy is used exactly when the polyominoes have the same
+    // total area as the open cells of the board, and a search on any other board is rejected by initialize.
+    dlx_matrix_polyomino(vector<polyomino> polyomino_list_in, int board_width_in, int board_height_in, vector<int> piece_counts_in=vector<int>()) {
         board_width = board_width_in;
-        num_constraints = num_mandatory_constraints;
-        array_width = board_width*board_width+polyomino_list_in.size();
-        optional_constraint_start_column = array_width;
-        matrix_header.resize(array_width);
+        board_height = board_height_in;
         polyomino_list = polyomino_list_in;
-        chrono::high_resolution_clock::time_point prev_time = chrono::high_resolution_clock::now();
+        piece_counts = piece_counts_in.empty()?vector<int>(polyomino_list.size(),1):piece_counts_in;
+        if (piece_counts.size()!=polyomino_list.size()) {
+            cout << "There must be one count for each polyomino.\n";
+            exit(1);
+        }
+        int num_cells = board_width*board_height;
+        array_width = num_cells+polyomino_list.size();
+        piece_column.resize(polyomino_list.size());
+        column_piece.resize(polyomino_list.size());
+        pieces_area = 0;
+        // the mandatory columns of the polyominoes used once come first, then the optional ones of the others
+        int next_column = num_cells;
+        for (int repeated = 0; repeated < 2; repeated++) {
+            if (repeated==1) {
+                optional_constraint_start_column = next_column;
+            }
+            for (int poly_num = 0; poly_num < polyomino_list.size(); poly_num++) {
+                if (piece_counts[poly_num]<1) {
+                    cout << "Every polyomino must be used at least once.\n";
+                    exit(1);
+                }
+                if ((piece_counts[poly_num]>1)==(repeated==1)) {
+                    piece_column[poly_num] = next_column;
+                    column_piece[next_column-num_cells] = poly_num;
+                    next_column++;
+                    pieces_area += piece_counts[poly_num]*polyomino_list[poly_num].getSize();
+                }
+            }
+        }
+        if (optional_constraint_start_column<array_width) {
+            column_capacity.assign(array_width,1);
+            for (int poly_num = 0; poly_num < polyomino_list.size(); poly_num++) {
+                column_capacity[piece_column[poly_num]] = piece_counts[poly_num];
+            }
+        }
+        matrix_header.resize(array_width);
+        chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
         generate();
         //polyomino_list[1].printShape(1);
         polyomino_generate();
-        cout << "Generation took " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
+        generation_us = chrono::duration<double,micro>(chrono::steady_clock::now()-start_time).count();
+    }
+    virtual int solution_size() const {
+        return board_width*board_height;
+    }
+    // Each cell is packed as the number of the polyomino covering it plus one, or 0 for a blocked cell.
+    virtual int packed_size() const {
+        return (board_width*board_height*dlx_bits_for(polyomino_list.size()+1)+7)/8;
+    }
+    // When set, every search rejects a state as soon as the uncovered cells fall into a region whose area no
+    // combination of the polyominoes left can make up, such as a pocket of four cells when tiling with
+    // pentominoes, instead of searching on until one of its cells has no placements left.
+    bool prune_dead_regions = false;
+    // The largest region prune_dead_regions checks, as larger ones are rarely impossible to tile by area alone
+    // and flood filling them on every state costs more than it saves.
+    int region_limit = 20;
+    // When set, every search finds one tiling of each class of tilings which are equivalent under the rotations
+    // and reflections of the open cells of the board, as long as some polyomino can be used to tell them apart.
+    bool break_symmetry = false;
+    // The number of tilings each tiling found by the last search stands for: the number of symmetries of its
+    // open cells if break_symmetry was set and they were broken, otherwise 1.
+    int symmetry_order() const {
+        return region_symmetries;
+    }
+    // The tilings found with break_symmetry set, the number of symmetries each stands for and the total number
+    // of tilings of the board.
+    struct symmetry_counts {
+        unsigned long long reduced = 0;
+        int symmetries = 1;
+        unsigned long long total = 0;
+    };
+    // Counts the tilings of the board with break_symmetry set, on num_threads threads as in count_parallel if
+    // num_threads is not 1, and multiplies the count back up to the total.
+    symmetry_counts count_distinct(vector<vector<int> > board_in, int num_threads=1) {
+        bool was_breaking = break_symmetry;
+        break_symmetry = true;
+        symmetry_counts counts;
+        counts.reduced = (num_threads==1)?count(board_in):count_parallel(board_in, num_threads);
+        counts.symmetries = region_symmetries;
+        counts.total = counts.reduced*counts.symmetries;
+        break_symmetry = was_breaking;
+        return counts;
     }
 protected:
-    virtual bool initialize(vector<vector<int> > &data_in, set<dlx_header_node*,header_compare> &header_tree, set<dlx_header_node*,header_compare> &optional_header_tree) {
+    virtual dlx_matrix* clone() const {
+        return new dlx_matrix_polyomino(*this);
+    }
+    virtual bool initialize(vector<vector<int> > &data_in, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
         board = data_in;
+        do_pruning = prune_dead_regions;
+        region_symmetries = 1;
+        if (break_symmetry) {
+            break_region_symmetry();
+        }
+        int open_cells = board_width*board_height;
         for (int row = 0; row < board.size(); row++) {
-            for (int col = 0; col < board[0].size(); col++) {
+            for (int col = 0; col < board[row].size(); col++) {
                 if (board[row][col]!=0) {
-                    dlx_header_node* header_target = &matrix_header[row*board_width+col];
-                    if ((*header_tree.begin())->count<=0) {
-                        cout << "Input is over-constrained.\n";
-                        cout << (*header_tree.begin())->matrix_column << " " << (*header_tree.begin())->count << endl;
-                        return false;
-                    }
-                    header_tree.erase(header_target);
-                    remove_column(header_target->top, header_tree,optional_header_tree);
-                    header_target->top->right->left = header_target->top->left;
-                    header_target->top->left->right = header_target->top->right;
+                    exclude_column(row*board_width+col);
+                    open_cells--;
                 }
             }
         }
+        if (!column_capacity.empty()&&open_cells!=pieces_area) {
+            report("The polyominoes do not have the same area as the open cells.\n");
+            return false;
+        }
+        if (!header_tree.empty()&&header_tree.lowest_count()<=0) {
+            report("Input is over-constrained.\n");
+            return false;
+        }
         return true;
     }
     virtual void generate() {
         for (int i = 0; i < array_width; i++) {
             matrix_header[i].count = 0;
             matrix_header[i].matrix_column = i;
-            matrix_header[i].top = NULL;
-            matrix_header[i].bottom = NULL;
+            matrix_header[i].top = -1;
+            matrix_header[i].bottom = -1;
         }
     }
+    // Places every orientation of every polyomino at every position where it fits on the board. Each placement
+    // is a row with a node for each block of the polyomino followed by a node for the polyomino's column.
+    // The cells an orientation covers relative to its upper left corner are worked out once, so each placement
+    // only adds its position to them, and the number of rows and nodes is known up front so that the arena is
+    // built with a single allocation. Orientations are never translations of each other, so no two placements
+    // of a polyomino cover the same cells and none need to be checked for.
     void polyomino_generate() {
-        for (int row = 0; row < board_width; row++) {
+        vector<orientation_offsets> orientations;
+        int num_rows = 0;
+        int num_nodes = 0;
+        for (int poly_num = 0; poly_num < polyomino_list.size(); poly_num++) {
+            polyomino &curr_poly = polyomino_list[poly_num];
+            for (int orient = 0; orient < curr_poly.getOrientations(); orient++) {
+                orientation_offsets offsets;
+                offsets.poly_num = poly_num;
+                offsets.x_len = curr_poly.getXLength(orient);
+                offsets.y_len = curr_poly.getYLength(orient);
+                offsets.cells.resize(curr_poly.getSize());
+                for (int i = 0; i < curr_poly.getSize(); i++) {
+                    offsets.cells[i] = curr_poly.getBlock(orient,i).first+curr_poly.getBlock(orient,i).second*board_width;
+                }
+                if (offsets.x_len<=board_width && offsets.y_len<=board_height) {
+                    int positions = (board_height-offsets.y_len+1)*(board_width-offsets.x_len+1);
+                    num_rows += positions;
+                    num_nodes += positions*(curr_poly.getSize()+1);
+                    orientations.push_back(offsets);
+                }
+            }
+        }
+        matrix.resize(num_nodes);
+        node_header.resize(num_nodes);
+        node_row.resize(num_nodes);
+        row_start.resize(num_rows+1);
+        row_start[num_rows] = num_nodes;
+        array_len = num_rows;
+        num_rows = 0;
+        num_nodes = 0;
+        for (int row = 0; row < board_height; row++) {
             for (int col = 0; col < board_width; col++) {
-                for (int poly_num = 0; poly_num < polyomino_list.size(); poly_num++) {
-                    polyomino curr_poly = polyomino_list[poly_num];
-                    for (int orient = 0; orient < curr_poly.getOrientations(); orient++) {
-                        if ((row+curr_poly.getYLength(orient)) <= board_width && (col+curr_poly.getXLength(orient)) <= board_width) {
-                            matrix.push_back(vector<dlx_matrix_node>(curr_poly.getSize()+1));
-                            for (int i = 0; i < curr_poly.getSize(); i++) {
-                                matrix.back()[i].matrix_row = matrix.size()-1;
-                                matrix.back()[i].header = &matrix_header[curr_poly.getBlock(orient,i).first+col+(curr_poly.getBlock(orient,i).second+row)*board_width];
-                                if (curr_poly.getBlock(orient,i).first+col+(curr_poly.getBlock(orient,i).second+row)*board_width>=board_width*board_width||curr_poly.getBlock(orient,i).first+col+(curr_poly.getBlock(orient,i).second+row)*board_width<0) {
-                                    cout << "Error at " << matrix.size() << " " << curr_poly.getBlock(orient,i).first << " " << curr_poly.getBlock(orient,i).second << endl;
-                                    exit(1);
-                                }
-                                matrix.back()[i].right = &matrix.back()[i+1];
-                                matrix.back()[i].left = &matrix.back()[((i>0)?i-1:curr_poly.getSize())];
-                                dlx_header_node* curr_header = matrix.back()[i].header;
-                                if (matrix.back()[i].header->top==NULL) {
-                                    matrix.back()[i].header->top = &matrix.back()[i];
-                                    matrix.back()[i].header->bottom = &matrix.back()[i];
-                                    matrix.back()[i].up = &matrix.back()[i];
-                                    matrix.back()[i].down = &matrix.back()[i];
-                                }
-                                else {
-                                    matrix.back()[i].up = curr_header->bottom;
-                                    matrix.back()[i].down = curr_header->top;
-                                    curr_header->bottom->down = &matrix.back()[i];
-                                    curr_header->top->up = &matrix.back()[i];
-                                    curr_header->bottom = &matrix.back()[i];
-                                }
-                                curr_header->count++;
-                            }
-                            int poly_constr = curr_poly.getSize();
-                            matrix.back()[poly_constr].matrix_row = matrix.size()-1;
-                            matrix.back()[poly_constr].header = &matrix_header[poly_num+board_width*board_width];
-                            matrix.back()[poly_constr].right = &matrix.back()[0];
-                            matrix.back()[poly_constr].left = &matrix.back()[curr_poly.getSize()-1];
-                            dlx_header_node* curr_header = matrix.back()[poly_constr].header;
-                            if (matrix.back()[poly_constr].header->top==NULL) {
-                                matrix.back()[poly_constr].header->top = &matrix.back()[poly_constr];
-                                matrix.back()[poly_constr].header->bottom = &matrix.back()[poly_constr];
-                                matrix.back()[poly_constr].up = &matrix.back()[poly_constr];
-                                matrix.back()[poly_constr].down = &matrix.back()[poly_constr];
-                            }
-                            else {
-                                matrix.back()[poly_constr].up = curr_header->bottom;
-                                matrix.back()[poly_constr].down = curr_header->top;
-                                curr_header->bottom->down = &matrix.back()[poly_constr];
-                                curr_header->top->up = &matrix.back()[poly_constr];
-                                curr_header->bottom = &matrix.back()[poly_constr];
-                            }
-                            curr_header->count++;
-                        }
-                        //cout << endl;
+                int corner = row*board_width+col;
+                for (int orient = 0; orient < orientations.size(); orient++) {
+                    const orientation_offsets &offsets = orientations[orient];
+                    if (row+offsets.y_len > board_height || col+offsets.x_len > board_width) {
+                        continue;
+                    }
+                    int row_length = offsets.cells.size()+1;
+                    row_start[num_rows] = num_nodes;
+                    for (int i = 0; i < offsets.cells.size(); i++) {
+                        link_node(num_nodes+i, num_rows, corner+offsets.cells[i], num_nodes, row_length);
+                        matrix_header[corner+offsets.cells[i]].count++;
+                    }
+                    link_node(num_nodes+offsets.cells.size(), num_rows, piece_column[offsets.poly_num], num_nodes, row_length);
+                    matrix_header[piece_column[offsets.poly_num]].count++;
+                    num_rows++;
+                    num_nodes += row_length;
+                }
+            }
+        }
+    }
+    // A placement can only cut off a region of uncovered cells next to it, so the regions around the last
+    // placement are flood filled, each only as far as region_limit cells (beyond which a region is taken to be
+    // tileable), and the state is rejected if one of them is closed off with an area which no combination of the
+    // polyominoes left can make up. Regions elsewhere were checked when they were cut off.
+    virtual bool prune_state() {
+        if (backtrack_stack.size()<=propagated_base) {
+            return false;
+        }
+        int num_cells = board_width*board_height;
+        if (region_seen.size()!=num_cells||region_stamp>numeric_limits<int>::max()-4*num_cells) {
+            region_seen.assign(num_cells,0);
+            region_stamp = 0;
+        }
+        // each flood fill has its own stamp, so that one stopped at region_limit does not wall off the next
+        int first_stamp = region_stamp+1;
+        bool areas_known = false;
+        int uncovered_cells = 0;
+        int placed_node = backtrack_stack.back().second;
+        int curr_node = placed_node;
+        do {
+            int placed_cell = node_header[curr_node];
+            curr_node = matrix[curr_node].right;
+            if (placed_cell>=num_cells) {
+                continue;
+            }
+            int placed_row = placed_cell/board_width;
+            int placed_col = placed_cell%board_width;
+            int seeds[4] = {placed_row>0?placed_cell-board_width:-1, placed_row<board_height-1?placed_cell+board_width:-1, placed_col>0?placed_cell-1:-1, placed_col<board_width-1?placed_cell+1:-1};
+            for (int seed = 0; seed < 4; seed++) {
+                if (seeds[seed]<0||region_seen[seeds[seed]]>=first_stamp||!header_tree.contains(&matrix_header[seeds[seed]])) {
+                    continue;
+                }
+                int area = flood_region(seeds[seed]);
+                if (area>region_limit) {
+                    continue;
+                }
+                if (!areas_known) {
+                    uncovered_cells = find_reachable_areas();
+                    areas_known = true;
+                }
+                // a region of every cell left is only cut off from the blocked cells, and is tiled by every piece left
+                if (area<uncovered_cells&&!reachable_areas[area]) {
+                    return true;
+                }
+            }
+        } while (curr_node!=placed_node);
+        return false;
+    }
+    // Counts the uncovered cells connected to the given one, stopping once there are more than region_limit.
+    int flood_region(int first_cell) {
+        int area = 0;
+        region_stamp++;
+        region_stack.clear();
+        region_seen[first_cell] = region_stamp;
+        region_stack.push_back(first_cell);
+        while (!region_stack.empty()&&area<=region_limit) {
+            int curr_cell = region_stack.back();
+            region_stack.pop_back();
+            area++;
+            int row = curr_cell/board_width;
+            int col = curr_cell%board_width;
+            int neighbors[4] = {row>0?curr_cell-board_width:-1, row<board_height-1?curr_cell+board_width:-1, col>0?curr_cell-1:-1, col<board_width-1?curr_cell+1:-1};
+            for (int i = 0; i < 4; i++) {
+                if (neighbors[i]>=0&&region_seen[neighbors[i]]!=region_stamp&&header_tree.contains(&matrix_header[neighbors[i]])) {
+                    region_seen[neighbors[i]] = region_stamp;
+                    region_stack.push_back(neighbors[i]);
+                }
+            }
+        }
+        return area+region_stack.size();
+    }
+    // Works out which areas up to region_limit the polyominoes left can make up together, by a bounded knapsack
+    // over their sizes, and returns the number of cells left uncovered (the mandatory columns left other than
+    // those of the polyominoes).
+    int find_reachable_areas() {
+        int uncovered_cells = header_tree.size();
+        reachable_areas.assign(region_limit+1,0);
+        reachable_areas[0] = 1;
+        for (int poly_num = 0; poly_num < polyomino_list.size(); poly_num++) {
+            dlx_header_node* header = &matrix_header[piece_column[poly_num]];
+            int copies_left = 0;
+            if (piece_counts[poly_num]==1) {
+                copies_left = header_tree.contains(header)?1:0;
+                uncovered_cells -= copies_left;
+            }
+            else if (optional_header_tree.contains(header)) {
+                copies_left = column_capacity[piece_column[poly_num]];
+            }
+            int size = polyomino_list[poly_num].getSize();
+            for (int copy = 0; copy < copies_left && copy*size < region_limit; copy++) {
+                for (int area = region_limit; area >= size; area--) {
+                    reachable_areas[area] |= reachable_areas[area-size];
+                }
+            }
+        }
+        return uncovered_cells;
+    }
+    // Finds the rotations and reflections of the bounding box of the open cells which map the open cells onto
+    // themselves, then looks for a polyomino none of whose placements is mapped onto itself by one of them. Every
+    // tiling then has a different placement of that polyomino from each of its images, so keeping only the
+    // placements which are the least of their orbit (by their sorted cells) leaves exactly one tiling of each
+    // class. Pieces are tried in order, so a caller may put the piece it wants restricted first. Only polyominoes
+    // used once can be restricted.
+    void break_region_symmetry() {
+        int num_cells = board_width*board_height;
+        vector<char> open(num_cells,1);
+        for (int row = 0; row < board.size(); row++) {
+            for (int col = 0; col < board[row].size(); col++) {
+                if (board[row][col]!=0) {
+                    open[row*board_width+col] = 0;
+                }
+            }
+        }
+        int top = board_height, left = board_width, bottom = -1, right = -1;
+        for (int cell = 0; cell < num_cells; cell++) {
+            if (open[cell]) {
+                top = min(top, cell/board_width);
+                bottom = max(bottom, cell/board_width);
+                left = min(left, cell%board_width);
+                right = max(right, cell%board_width);
+            }
+        }
+        int height = bottom-top+1;
+        int width = right-left+1;
+        // bit 2 transposes the box (only when it is square), then bit 0 reflects its columns and bit 1 its rows
+        vector<vector<int> > symmetries;
+        for (int symmetry = 1; symmetry < 8 && bottom>=0; symmetry++) {
+            if ((symmetry&4) && height!=width) {
+                continue;
+            }
+            vector<int> image(num_cells,-1);
+            bool preserved = true;
+            for (int cell = 0; cell < num_cells && preserved; cell++) {
+                if (open[cell]) {
+                    int row = cell/board_width-top;
+                    int col = cell%board_width-left;
+                    if (symmetry&4) {
+                        swap(row, col);
+                    }
+                    if (symmetry&1) {
+                        col = width-1-col;
+                    }
+                    if (symmetry&2) {
+                        row = height-1-row;
+                    }
+                    image[cell] = (row+top)*board_width+col+left;
+                    preserved = open[image[cell]];
+                }
+            }
+            if (preserved) {
+                symmetries.push_back(image);
+            }
+        }
+        if (symmetries.empty()) {
+            return;
+        }
+        vector<int> placement, mapped_placement, discarded;
+        for (int poly_num = 0; poly_num < polyomino_list.size(); poly_num++) {
+            discarded.clear();
+            bool free_orbits = piece_counts[poly_num]==1;
+            for (int matrix_row = 0; matrix_row < array_len && free_orbits; matrix_row++) {
+                int poly_node = row_start[matrix_row+1]-1;
+                if (node_header[poly_node]!=piece_column[poly_num]) {
+                    continue;
+                }
+                placement.assign(node_header.begin()+row_start[matrix_row], node_header.begin()+poly_node);
+                bool fits = true;
+                for (int i = 0; i < placement.size(); i++) {
+                    fits = fits && open[placement[i]];
+                }
+                if (!fits) {
+                    continue; // removed with the blocked cells anyway
+                }
+                sort(placement.begin(), placement.end());
+                bool least = true;
+                for (int symmetry = 0; symmetry < symmetries.size(); symmetry++) {
+                    mapped_placement.resize(placement.size());
+                    for (int i = 0; i < placement.size(); i++) {
+                        mapped_placement[i] = symmetries[symmetry][placement[i]];
                     }
+                    sort(mapped_placement.begin(), mapped_placement.end());
+                    free_orbits = free_orbits && mapped_placement!=placement;
+                    least = least && !(mapped_placement<placement);
+                }
+                if (!least) {
+                    discarded.push_back(poly_node);
                 }
             }
+            if (free_orbits) {
+                for (int i = 0; i < discarded.size(); i++) {
+                    eliminate_row(discarded[i]);
+                }
+                region_symmetries = symmetries.size()+1;
+                return;
+            }
         }
-        array_len = matrix.size();
     }
-    virtual vector<vector<int> > interpret_result(stack<pair<dlx_header_node*,dlx_matrix_node*> > backtrack_stack) {
-        chrono::high_resolution_clock::time_point prev_time = chrono::high_resolution_clock::now();
+    virtual vector<vector<int> > interpret_result(const vector<pair<int,int> > &choices) {
         vector<vector<int> > result;
         if (board!=vector<vector<int> >()) {
             result = board;
         }
         else {
-            result = vector<vector<int> >(board_width,vector<int>(board_width));
+            result = vector<vector<int> >(board_height,vector<int>(board_width));
         }
-        while (!backtrack_stack.empty()) {
-            int matrix_column = matrix[backtrack_stack.top().second->matrix_row][0].header->matrix_column;
-            int matrix_row = backtrack_stack.top().second->matrix_row;
-            for (int i = 0; i < matrix[matrix_row].size()-1; i++) {
-                result[matrix[matrix_row][i].header->matrix_column/board_width][matrix[matrix_row][i].header->matrix_column%board_width] = matrix[matrix_row].back().header->matrix_column-board_width*board_width;
-            }
-            backtrack_stack.pop();
+        for (int i = 0; i < choices.size(); i++) {
+            apply_row(result, choices[i].second);
         }
-        if (do_debug_output)
-            cout << "Interpretation took " << chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now()-prev_time).count() << "mus" << endl;
         return result;
     }
+    virtual void apply_row(vector<vector<int> > &board, int node) const {
+        int matrix_row = node_row[node];
+        int poly_num = column_piece[node_header[row_start[matrix_row+1]-1]-board_width*board_height];
+        for (int i = row_start[matrix_row]; i < row_start[matrix_row+1]-1; i++) {
+            board[node_header[i]/board_width][node_header[i]%board_width] = poly_num;
+        }
+    }
+    virtual void decode(const vector<pair<int,int> > &choices, int* buffer) const {
+        if (board!=vector<vector<int> >()) {
+            for (int row = 0; row < board_height; row++) {
+                copy(board[row].begin(), board[row].end(), buffer+row*board_width);
+            }
+        }
+        else {
+            fill(buffer, buffer+board_width*board_height, 0);
+        }
+        for (int i = 0; i < choices.size(); i++) {
+            int matrix_row = node_row[choices[i].second];
+            int poly_num = column_piece[node_header[row_start[matrix_row+1]-1]-board_width*board_height];
+            for (int j = row_start[matrix_row]; j < row_start[matrix_row+1]-1; j++) {
+                buffer[node_header[j]] = poly_num;
+            }
+        }
+    }
+    virtual void pack(const int* solution, unsigned char* packed) const {
+        int bits = dlx_bits_for(polyomino_list.size()+1);
+        for (int cell = 0; cell < board_width*board_height; cell++) {
+            if (board==vector<vector<int> >()||board[cell/board_width][cell%board_width]==0) {
+                dlx_pack_bits(packed, cell, bits, solution[cell]+1);
+            }
+        }
+    }
+    virtual void unpack(const unsigned char* packed, int* solution) const {
+        int bits = dlx_bits_for(polyomino_list.size()+1);
+        for (int cell = 0; cell < board_width*board_height; cell++) {
+            int poly_code = dlx_unpack_bits(packed, cell, bits);
+            if (poly_code!=0) {
+                solution[cell] = poly_code-1;
+            }
+        }
+    }
+    virtual vector<vector<int> > unflatten(const int* solution) const {
+        return dlx_grid(solution, board_width, board_height);
+    }
     virtual int get_count(int matrix_column) {
         if (matrix_column<board_width*2) {
             return board_width;
@@ -836,10 +3179,197 @@ protected:
         }
     }
 private:
+    // An orientation of a polyomino as the cells its blocks cover relative to its upper left corner, used by
+    // polyomino_generate.
+    struct orientation_offsets {
+        int poly_num;
+        int x_len;
+        int y_len;
+        vector<int> cells;
+    };
     vector<vector<int> > board;
     vector<polyomino> polyomino_list;
     int board_width;
-    int num_mandatory_constraints;
+    int board_height;
+    // The number of times each polyomino is used, the column of each polyomino, the polyomino of each column
+    // (from the first polyomino column) and the area of all the copies of the polyominoes.
+    vector<int> piece_counts;
+    vector<int> piece_column;
+    vector<int> column_piece;
+    int pieces_area;
+    // Storage reused by every call of prune_state. Each flood fill marks the cells it reaches in region_seen
+    // with a new region_stamp.
+    vector<char> reachable_areas;
+    vector<int> region_seen;
+    vector<int> region_stack;
+    int region_stamp = 0;
+    int region_symmetries = 1;
+};
+
+/*
+ * This class solves a general exact cover problem with colors given as a list of rows, each a list of (column,
+ * color) pairs. The first num_primary columns must each be covered by exactly one row of a solution, and the
+ * num_secondary columns after them by at most one row, except that any number of rows may share a secondary
+ * column as long as they all give it the same positive color (a color of 0 claims the column outright). This lets
+ * a constraint shared between rows, such as a letter where two words of a crossword cross, be a single column
+ * instead of one row for every combination of the rows which agree on it.
+ * The input is a list of rows which must be in the solution, and a solution is the list of its rows in
+ * increasing order, including those given.
+ */
+class dlx_matrix_xcc : public dlx_matrix<vector<int>, vector<int> > {
+public:
+    dlx_matrix_xcc(int num_primary_in, int num_secondary_in, const vector<vector<pair<int,int> > > &rows_in) {
+        num_primary = num_primary_in;
+        rows = rows_in;
+        array_width = num_primary_in+num_secondary_in;
+        optional_constraint_start_column = num_primary;
+        array_len = rows.size();
+        matrix_header.resize(array_width);
+        chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+        generate();
+        generation_us = chrono::duration<double,micro>(chrono::steady_clock::now()-start_time).count();
+    }
+    // A solution is decoded as a flag for each row, 1 if the row is in the solution.
+    virtual int solution_size() const {
+        return array_len;
+    }
+    virtual int packed_size() const {
+        return (array_len+7)/8;
+    }
+protected:
+    virtual dlx_matrix* clone() const {
+        return new dlx_matrix_xcc(*this);
+    }
+    virtual void generate() {
+        int num_nodes = 0;
+        bool has_colors = false;
+        vector<char> in_row(array_width,0);
+        for (int matrix_row = 0; matrix_row < rows.size(); matrix_row++) {
+            if (rows[matrix_row].empty()) {
+                cout << "Row " << matrix_row << " is empty.\n";
+                exit(1);
+            }
+            for (int i = 0; i < rows[matrix_row].size(); i++) {
+                int column = rows[matrix_row][i].first;
+                int color = rows[matrix_row][i].second;
+                if (column<0||column>=array_width||in_row[column]||color<0||(color>0&&column<num_primary)) {
+                    cout << "Row " << matrix_row << " has a repeated or invalid column, or a color on a primary column.\n";
+                    exit(1);
+                }
+                in_row[column] = 1;
+                has_colors = has_colors||color>0;
+            }
+            for (int i = 0; i < rows[matrix_row].size(); i++) {
+                in_row[rows[matrix_row][i].first] = 0;
+            }
+            num_nodes += rows[matrix_row].size();
+        }
+        for (int i = 0; i < array_width; i++) {
+            matrix_header[i].count = 0;
+            matrix_header[i].matrix_column = i;
+            matrix_header[i].top = -1;
+            matrix_header[i].bottom = -1;
+        }
+        matrix.resize(num_nodes);
+        node_header.resize(num_nodes);
+        node_row.resize(num_nodes);
+        row_start.resize(array_len+1);
+        if (has_colors) {
+            node_color.assign(num_nodes,0);
+        }
+        num_nodes = 0;
+        for (int matrix_row = 0; matrix_row < rows.size(); matrix_row++) {
+            row_start[matrix_row] = num_nodes;
+            for (int i = 0; i < rows[matrix_row].size(); i++) {
+                link_node(num_nodes+i, matrix_row, rows[matrix_row][i].first, num_nodes, rows[matrix_row].size());
+                matrix_header[rows[matrix_row][i].first].count++;
+                if (has_colors) {
+                    node_color[num_nodes+i] = rows[matrix_row][i].second;
+                }
+            }
+            num_nodes += rows[matrix_row].size();
+        }
+        row_start[array_len] = num_nodes;
+    }
+    virtual bool initialize(vector<int> &given_rows, dlx_column_index &header_tree, dlx_column_index &optional_header_tree) {
+        initial_data = given_rows;
+        // the given rows are checked against each other first, as a row hidden by the color of another may still
+        // be linked into the column it was hidden from
+        vector<int> given_color(array_width,-1);
+        for (int i = 0; i < given_rows.size(); i++) {
+            if (given_rows[i]<0||given_rows[i]>=array_len) {
+                report("Input is over-constrained.\n");
+                return false;
+            }
+            for (int j = 0; j < rows[given_rows[i]].size(); j++) {
+                int column = rows[given_rows[i]][j].first;
+                int color = rows[given_rows[i]][j].second;
+                if (given_color[column]==0||(given_color[column]>0&&given_color[column]!=color)) {
+                    report("Input is over-constrained.\n");
+                    return false;
+                }
+                given_color[column] = color;
+            }
+        }
+        for (int i = 0; i < given_rows.size(); i++) {
+            if (!fix_row(row_start[given_rows[i]])) {
+                report("Input is over-constrained.\n");
+                return false;
+            }
+        }
+        sort(initial_data.begin(), initial_data.end());
+        return true;
+    }
+    virtual vector<int> interpret_result(const vector<pair<int,int> > &choices) {
+        vector<int> solution = initial_data;
+        for (int i = 0; i < choices.size(); i++) {
+            apply_row(solution, choices[i].second);
+        }
+        return solution;
+    }
+    virtual void apply_row(vector<int> &solution, int node) const {
+        int matrix_row = node_row[node];
+        solution.insert(lower_bound(solution.begin(), solution.end(), matrix_row), matrix_row);
+    }
+    virtual void decode(const vector<pair<int,int> > &choices, int* buffer) const {
+        fill(buffer, buffer+array_len, 0);
+        for (int i = 0; i < initial_data.size(); i++) {
+            buffer[initial_data[i]] = 1;
+        }
+        for (int i = 0; i < choices.size(); i++) {
+            buffer[node_row[choices[i].second]] = 1;
+        }
+    }
+    virtual void pack(const int* solution, unsigned char* packed) const {
+        for (int matrix_row = 0; matrix_row < array_len; matrix_row++) {
+            dlx_pack_bits(packed, matrix_row, 1, solution[matrix_row]);
+        }
+    }
+    virtual void unpack(const unsigned char* packed, int* solution) const {
+        for (int matrix_row = 0; matrix_row < array_len; matrix_row++) {
+            solution[matrix_row] = dlx_unpack_bits(packed, matrix_row, 1);
+        }
+    }
+    virtual vector<int> unflatten(const int* solution) const {
+        vector<int> result;
+        for (int matrix_row = 0; matrix_row < array_len; matrix_row++) {
+            if (solution[matrix_row]) {
+                result.push_back(matrix_row);
+            }
+        }
+        return result;
+    }
+    // Unused, as generate is overridden.
+    virtual int get_count(int matrix_column) {
+        return matrix_header[matrix_column].count;
+    }
+    virtual int get_column(int matrix_row, int constraint_num) {
+        return rows[matrix_row][constraint_num].first;
+    }
+private:
+    vector<vector<pair<int,int> > > rows;
+    int num_primary;
 };
 
+
 #endif
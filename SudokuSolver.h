@@ -0,0 +1,525 @@
+#ifndef SUDOKU_SOLVER_H
+#define SUDOKU_SOLVER_H
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cmath>
+#include <type_traits>
+#include "DLX.h"
+
+/*
+ * These classes put the sudoku solvers behind one interface so that the backend can be chosen at runtime.
+ * The dancing links backend handles any square width. The bitboard backend handles widths up to 25 and is
+ * much faster at checking puzzles with a unique solution, since it works directly on candidate bitmasks instead of
+ * an exact cover matrix, but gains little (or loses) when listing the solutions of puzzles with many.
+ */
+
+using namespace std;
+
+// Interface shared by the sudoku backends.
+// Boards are square vectors of ints with -1 representing empty cells, as for dlx_matrix_sudoku.
+class sudoku_solver {
+public:
+    virtual ~sudoku_solver() {}
+    // Returns up to max_solutions solutions to the board (all of them if max_solutions is -1),
+    // or an empty vector if it has none or is not a valid board.
+    virtual vector<vector<vector<int> > > solve(vector<vector<int> > board, int max_solutions) = 0;
+    // Returns whether the board has no solution, exactly one, or more than one, stopping at the second solution.
+    // The first solution is written to first_solution if one is given.
+    virtual dlx_uniqueness verify_unique(vector<vector<int> > board, vector<vector<int> >* first_solution=NULL) {
+        vector<vector<vector<int> > > solutions = solve(board, 2);
+        if (solutions.empty()) {
+            return dlx_uniqueness::none;
+        }
+        if (first_solution!=NULL) {
+            first_solution->swap(solutions[0]);
+        }
+        return (solutions.size()>1)?dlx_uniqueness::multiple:dlx_uniqueness::unique;
+    }
+    // Returns the name of the backend, as accepted by new_sudoku_solver.
+    virtual string name() const = 0;
+};
+
+// Backend which uses the dancing links solver, keeping one generated matrix for the last width it was given.
+class dlx_sudoku_solver : public sudoku_solver {
+public:
+    virtual vector<vector<vector<int> > > solve(vector<vector<int> > board, int max_solutions) {
+        return matrix_for(board.size()).solve(board, max_solutions);
+    }
+    virtual dlx_uniqueness verify_unique(vector<vector<int> > board, vector<vector<int> >* first_solution=NULL) {
+        return matrix_for(board.size()).verify_unique(board, first_solution);
+    }
+    virtual string name() const {
+        return "dlx";
+    }
+private:
+    // Returns the matrix for the given width, generating a new one if the width has changed.
+    dlx_matrix<vector<vector<int> >, vector<vector<int> > >& matrix_for(int width) {
+        if (!matrix||width!=matrix_width) {
+            matrix.reset(new_dlx_matrix_sudoku(width));
+            matrix_width = width;
+        }
+        return *matrix;
+    }
+    unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > matrix;
+    int matrix_width = 0;
+};
+
+// Backend for a fixed width which keeps a bitmask of the candidate values of every cell. Placing a value clears
+// it from the candidates of the cell's peers (the other cells in its row, column and box). Each search step
+// places every naked single (a cell with one candidate left) and hidden single (a value with one cell left in
+// a row, column or box) until none are left, removing locked candidates as well on boards larger than 9x9. It
+// then branches on the empty cell with the fewest candidates, or on the places left for a value in a unit when
+// there are fewer of those.
+template <int N>
+class bitboard_sudoku_solver_static final : public sudoku_solver {
+public:
+    static_assert(N>0&&N<=25&&dlx_int_sqrt(N)*dlx_int_sqrt(N)==N, "The sudoku width must be a square no larger than 25.");
+    bitboard_sudoku_solver_static() {
+        // units 0 to N-1 are rows, then columns, then boxes
+        int unit_size[N*3] = {};
+        for (int cell = 0; cell < N*N; cell++) {
+            int row = cell/N;
+            int col = cell%N;
+            int box = row/sqrt_width*sqrt_width+col/sqrt_width;
+            unit_cells[row][unit_size[row]++] = cell;
+            unit_cells[N+col][unit_size[N+col]++] = cell;
+            unit_cells[N*2+box][unit_size[N*2+box]++] = cell;
+            cell_box[cell] = box;
+            int curr_peer = 0;
+            for (int other = 0; other < N*N; other++) {
+                int other_row = other/N;
+                int other_col = other%N;
+                if (other!=cell&&(other_row==row||other_col==col||(other_row/sqrt_width==row/sqrt_width&&other_col/sqrt_width==col/sqrt_width))) {
+                    peers[cell][curr_peer++] = other;
+                }
+            }
+        }
+        // every placement below the givens is made on an empty cell, so the search is at most N*N levels deep
+        levels.resize(N*N+1);
+    }
+    virtual vector<vector<vector<int> > > solve(vector<vector<int> > board, int max_solutions) {
+        solutions.clear();
+        if (!is_valid(board)) {
+            return vector<vector<vector<int> > >();
+        }
+        solution_limit = (max_solutions==-1)?numeric_limits<int>::max():max_solutions;
+        board_state &start = levels[0];
+        for (int unit = 0; unit < N*3; unit++) {
+            start.unit_placed[unit] = 0;
+        }
+        start.empty_cells = N*N;
+        // the givens are entered in their units first, rejecting a value given twice in a unit, and the empty
+        // cells then get every value which is not given in one of their units, which is much cheaper than
+        // placing the givens one at a time
+        for (int cell = 0; cell < N*N; cell++) {
+            start.candidates[cell] = 0;
+            start.placed[cell] = 0;
+            if (board[cell/N][cell%N]!=-1) {
+                value_mask mask = 1u<<(board[cell/N][cell%N]-1);
+                value_mask &row_placed = start.unit_placed[cell/N];
+                value_mask &col_placed = start.unit_placed[N+cell%N];
+                value_mask &box_placed = start.unit_placed[N*2+cell_box[cell]];
+                if ((row_placed|col_placed|box_placed)&mask) {
+                    return vector<vector<vector<int> > >();
+                }
+                row_placed |= mask;
+                col_placed |= mask;
+                box_placed |= mask;
+                start.placed[cell] = mask;
+                start.empty_cells--;
+            }
+        }
+        queue_size = 0;
+        for (int cell = 0; cell < N*N; cell++) {
+            if (start.placed[cell]==0) {
+                value_mask cell_candidates = full_mask&~(start.unit_placed[cell/N]|start.unit_placed[N+cell%N]|start.unit_placed[N*2+cell_box[cell]]);
+                if (cell_candidates==0) {
+                    return vector<vector<vector<int> > >();
+                }
+                start.candidates[cell] = cell_candidates;
+                if ((cell_candidates&(cell_candidates-1))==0) {
+                    single_queue[queue_size++] = cell;
+                }
+            }
+        }
+        if (solution_limit>0) {
+            search(0);
+        }
+        // swapped out rather than returned, so that the solutions are not copied
+        vector<vector<vector<int> > > result;
+        result.swap(solutions);
+        return result;
+    }
+    virtual string name() const {
+        return "bitboard";
+    }
+private:
+    static const int sqrt_width = dlx_int_sqrt(N);
+    static const int num_peers = 3*(N-1)-2*(sqrt_width-1);
+    // a 1x1 board has no peers, but the arrays sized by num_peers still need room for its one cell
+    static const int peer_slots = (num_peers>0)?num_peers:1;
+    static const unsigned int full_mask = (N==32)?~0u:(1u<<N)-1;
+    // The state of one level of the search. Filled cells have no candidates and the mask of their value in
+    // placed, empty cells have a placed mask of 0.
+    // Masks are 16 bits wide where they fit, which halves the state copied for each branch.
+    typedef typename conditional<(N<=16),unsigned short,unsigned int>::type value_mask;
+    struct board_state {
+        value_mask candidates[N*N];
+        value_mask placed[N*N];
+        // the values placed in each row, column and box (in the same order as unit_cells)
+        value_mask unit_placed[N*3];
+        int empty_cells;
+    };
+    // Checks that the board is N by N and every cell is -1 or a value from 1 to N.
+    static bool is_valid(const vector<vector<int> > &board) {
+        if (board.size()!=N) {
+            return false;
+        }
+        for (int row = 0; row < N; row++) {
+            if (board[row].size()!=N) {
+                return false;
+            }
+            for (int col = 0; col < N; col++) {
+                if (board[row][col]!=-1&&(board[row][col]<1||board[row][col]>N)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    // Places the value bit (0 to N-1) in an empty cell and removes it from the candidates of the cell's peers,
+    // queueing any peer left with a single candidate. Returns false if the value is not a candidate of the
+    // cell or a peer is left with no candidates.
+    inline bool place(board_state &state, int cell, int bit) {
+        unsigned int mask = 1u<<bit;
+        if (!(state.candidates[cell]&mask)) {
+            return false;
+        }
+        state.candidates[cell] = 0;
+        state.placed[cell] = mask;
+        state.unit_placed[cell/N] |= mask;
+        state.unit_placed[N+cell%N] |= mask;
+        state.unit_placed[N*2+cell_box[cell]] |= mask;
+        state.empty_cells--;
+        // the peers are cleared without branching, flagging the ones which lost the value and have at most one
+        // candidate left (filled peers have no candidates, so they never lose it); there are at most 64 peers
+        unsigned long long flagged = 0;
+        for (int i = 0; i < num_peers; i++) {
+            int peer = peers[cell][i];
+            unsigned int peer_candidates = state.candidates[peer];
+            unsigned int remaining = peer_candidates&~mask;
+            state.candidates[peer] = remaining;
+            flagged |= (unsigned long long)(((peer_candidates>>bit)&1)&((remaining&(remaining-1))==0))<<i;
+        }
+        while (flagged) {
+            int peer = peers[cell][__builtin_ctzll(flagged)];
+            flagged &= flagged-1;
+            if (state.candidates[peer]==0) {
+                return false;
+            }
+            single_queue[queue_size++] = peer;
+        }
+        return true;
+    }
+    // Places naked and hidden singles, and above 9x9 removes locked candidates, until there are none left.
+    // Returns false if the board is found to have no solution.
+    bool propagate(board_state &state) {
+        while (true) {
+            while (queue_size>0) {
+                int cell = single_queue[--queue_size];
+                // the cell may have been filled since it was queued
+                if (state.candidates[cell]!=0&&!place(state, cell, __builtin_ctz(state.candidates[cell]))) {
+                    return false;
+                }
+            }
+            if (state.empty_cells==0) {
+                return true;
+            }
+            bool found_hidden = false;
+            for (int unit = 0; unit < N*3; unit++) {
+                unsigned int used = state.unit_placed[unit];
+                if (used==full_mask) {
+                    continue;
+                }
+                // values which are a candidate of at least one, and of at least two, empty cells in the unit
+                unsigned int once = 0;
+                unsigned int twice = 0;
+                const int* cells = unit_cells[unit];
+                for (int i = 0; i < N; i++) {
+                    unsigned int cell_candidates = state.candidates[cells[i]];
+                    twice |= once&cell_candidates;
+                    once |= cell_candidates;
+                }
+                if ((once|used)!=full_mask) {
+                    return false;
+                }
+                unsigned int hidden = once&~twice;
+                while (hidden!=0) {
+                    int bit = __builtin_ctz(hidden);
+                    hidden &= hidden-1;
+                    for (int i = 0; i < N; i++) {
+                        if ((state.candidates[cells[i]]>>bit)&1) {
+                            if (!place(state, cells[i], bit)) {
+                                return false;
+                            }
+                            break;
+                        }
+                    }
+                    found_hidden = true;
+                }
+            }
+            if (!found_hidden&&queue_size==0) {
+                // up to 9x9 the singles leave little for locked candidates to find, and checking for them costs
+                // more than the nodes they save
+                if (N<=9) {
+                    return true;
+                }
+                bool eliminated = false;
+                if (!eliminate_locked(state, eliminated)) {
+                    return false;
+                }
+                if (!eliminated) {
+                    return true;
+                }
+            }
+        }
+    }
+    // Removes locked candidates. The cells a row (or column) shares with a box form a segment, and a value whose
+    // candidates in the box all lie in one segment can be removed from the rest of the row, while one whose
+    // candidates in the row all lie in one segment can be removed from the rest of the box. Sets eliminated if
+    // any candidate is removed, and returns false if a cell is left with none.
+    bool eliminate_locked(board_state &state, bool &eliminated) {
+        unsigned int segment[sqrt_width][sqrt_width];
+        // direction 0 takes the segments of the rows, 1 those of the columns, a band being sqrt_width lines
+        for (int direction = 0; direction < 2; direction++) {
+            for (int band = 0; band < sqrt_width; band++) {
+                for (int line = 0; line < sqrt_width; line++) {
+                    for (int box = 0; box < sqrt_width; box++) {
+                        segment[line][box] = 0;
+                        for (int i = 0; i < sqrt_width; i++) {
+                            segment[line][box] |= state.candidates[segment_cell(direction, band, line, box, i)];
+                        }
+                    }
+                }
+                for (int line = 0; line < sqrt_width; line++) {
+                    for (int box = 0; box < sqrt_width; box++) {
+                        unsigned int rest_of_box = 0;
+                        unsigned int rest_of_line = 0;
+                        for (int other = 0; other < sqrt_width; other++) {
+                            rest_of_box |= (other!=line)?segment[other][box]:0;
+                            rest_of_line |= (other!=box)?segment[line][other]:0;
+                        }
+                        // values confined to this segment within the box, which the rest of the line loses
+                        unsigned int pointing = segment[line][box]&~rest_of_box&rest_of_line;
+                        // values confined to this segment within the line, which the rest of the box loses
+                        unsigned int claiming = segment[line][box]&~rest_of_line&rest_of_box;
+                        for (int other = 0; other < sqrt_width; other++) {
+                            if (other!=box&&(segment[line][other]&pointing)!=0&&!remove_from_segment(state, direction, band, line, other, pointing, segment[line][other])) {
+                                return false;
+                            }
+                            if (other!=line&&(segment[other][box]&claiming)!=0&&!remove_from_segment(state, direction, band, other, box, claiming, segment[other][box])) {
+                                return false;
+                            }
+                        }
+                        eliminated = eliminated||pointing!=0||claiming!=0;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+    // Returns the index-th cell of the segment where the given line of a band meets the given box of the band.
+    static inline int segment_cell(int direction, int band, int line, int box, int index) {
+        int along = band*sqrt_width+line;
+        int across = box*sqrt_width+index;
+        return (direction==0)?along*N+across:across*N+along;
+    }
+    // Removes the values in mask from the candidates of a segment, queueing any cell left with a single
+    // candidate and updating the segment's mask. Returns false if a cell is left with no candidates.
+    inline bool remove_from_segment(board_state &state, int direction, int band, int line, int box, unsigned int mask, unsigned int &segment_mask) {
+        segment_mask = 0;
+        for (int i = 0; i < sqrt_width; i++) {
+            int cell = segment_cell(direction, band, line, box, i);
+            value_mask cell_candidates = state.candidates[cell];
+            if (cell_candidates&mask) {
+                cell_candidates &= ~mask;
+                state.candidates[cell] = cell_candidates;
+                if (cell_candidates==0) {
+                    return false;
+                }
+                if ((cell_candidates&(cell_candidates-1))==0) {
+                    single_queue[queue_size++] = cell;
+                }
+            }
+            segment_mask |= cell_candidates;
+        }
+        return true;
+    }
+    // Counts the set bits of a mask. This is used instead of __builtin_popcount, which is a library call
+    // unless the build targets a CPU with a popcount instruction.
+    static inline int count_bits(unsigned int mask) {
+        mask = mask-((mask>>1)&0x55555555u);
+        mask = (mask&0x33333333u)+((mask>>2)&0x33333333u);
+        mask = (mask+(mask>>4))&0x0F0F0F0Fu;
+        return (mask*0x01010101u)>>24;
+    }
+    // Searches below the state at the given depth, saving solutions until solution_limit is reached.
+    void search(int depth) {
+        board_state &state = levels[depth];
+        if (!propagate(state)) {
+            return;
+        }
+        if (state.empty_cells==0) {
+            solutions.push_back(vector<vector<int> >(N, vector<int>(N)));
+            for (int cell = 0; cell < N*N; cell++) {
+                solutions.back()[cell/N][cell%N] = __builtin_ctz(state.placed[cell])+1;
+            }
+            return;
+        }
+        // empty cells left in each unit, by which ties are broken below
+        int open_cells[N*3];
+        for (int unit = 0; unit < N*3; unit++) {
+            open_cells[unit] = N-count_bits(state.unit_placed[unit]);
+        }
+        // among the cells with the fewest candidates, the one whose row, column and box have the most empty
+        // cells is taken, as it constrains the most other cells, which keeps the search out of long dead ends
+        int branch_cell = -1;
+        int fewest = N+1;
+        int most_open = -1;
+        for (int cell = 0; cell < N*N; cell++) {
+            if (state.candidates[cell]!=0) {
+                int count = count_bits(state.candidates[cell]);
+                int open = open_cells[cell/N]+open_cells[N+cell%N]+open_cells[N*2+cell_box[cell]];
+                if (count<fewest||(count==fewest&&open>most_open)) {
+                    fewest = count;
+                    most_open = open;
+                    branch_cell = cell;
+                }
+            }
+        }
+        // a value with fewer places left in a row, column or box than any cell has candidates is a narrower
+        // branch, as dancing links finds by treating both as columns (after propagation a value always has at
+        // least two places, so this is only worth checking when no cell has two candidates)
+        int branch_unit = -1;
+        int branch_bit = 0;
+        int cell_fewest = fewest;
+        for (int unit = 0; unit < N*3 && cell_fewest>2; unit++) {
+            unsigned int open_values = full_mask&~state.unit_placed[unit];
+            if (open_values==0) {
+                continue;
+            }
+            // bit-sliced counters of the number of cells each value is a candidate of, saturating at 8
+            unsigned int ones = 0, twos = 0, fours = 0, eights = 0;
+            const int* cells = unit_cells[unit];
+            for (int i = 0; i < N; i++) {
+                unsigned int carry = ones&state.candidates[cells[i]];
+                ones ^= state.candidates[cells[i]];
+                unsigned int carry2 = twos&carry;
+                twos ^= carry;
+                eights |= fours&carry2;
+                fours ^= carry2;
+            }
+            // a unit only replaces the cell with fewer places, and an earlier unit with as few places if it
+            // has more empty cells
+            for (int count = 2; count <= min(fewest,7); count++) {
+                unsigned int exact = open_values&~eights&((count&1)?ones:~ones)&((count&2)?twos:~twos)&((count&4)?fours:~fours);
+                if (exact!=0) {
+                    if (count<fewest||(branch_unit!=-1&&open_cells[unit]>most_open)) {
+                        fewest = count;
+                        most_open = open_cells[unit];
+                        branch_unit = unit;
+                        branch_bit = __builtin_ctz(exact);
+                    }
+                    break;
+                }
+            }
+        }
+        if (branch_unit!=-1) {
+            const int* cells = unit_cells[branch_unit];
+            for (int i = 0; i < N&&solutions.size()<solution_limit; i++) {
+                if ((state.candidates[cells[i]]>>branch_bit)&1) {
+                    levels[depth+1] = state;
+                    queue_size = 0;
+                    if (place(levels[depth+1], cells[i], branch_bit)) {
+                        search(depth+1);
+                    }
+                }
+            }
+            return;
+        }
+        unsigned int branch_candidates = state.candidates[branch_cell];
+        while (branch_candidates!=0&&solutions.size()<solution_limit) {
+            levels[depth+1] = state;
+            int bit = __builtin_ctz(branch_candidates);
+            branch_candidates &= branch_candidates-1;
+            // anything left in the queue belongs to a branch which has already been abandoned
+            queue_size = 0;
+            if (place(levels[depth+1], branch_cell, bit)) {
+                search(depth+1);
+            }
+        }
+    }
+    int unit_cells[N*3][N];
+    int cell_box[N*N];
+    int peers[N*N][peer_slots];
+    vector<board_state> levels;
+    // Cells left with a single candidate which have not been filled yet. A placement queues at most one cell
+    // per peer and every cell is placed at most once before the queue is drained, which bounds its size.
+    int single_queue[N*N*peer_slots];
+    int queue_size = 0;
+    vector<vector<vector<int> > > solutions;
+    int solution_limit = 0;
+};
+
+// Bitboard backend for any width up to 25, which hands each board to a bitboard_sudoku_solver_static of its width.
+class bitboard_sudoku_solver : public sudoku_solver {
+public:
+    // The widest board the bitboard backend accepts (the largest square width whose values fit in a 32-bit mask).
+    static const int max_width = 25;
+    virtual vector<vector<vector<int> > > solve(vector<vector<int> > board, int max_solutions) {
+        if (!solver||board.size()!=solver_width) {
+            switch (board.size()) {
+                case 1:
+                    solver.reset(new bitboard_sudoku_solver_static<1>());
+                    break;
+                case 4:
+                    solver.reset(new bitboard_sudoku_solver_static<4>());
+                    break;
+                case 9:
+                    solver.reset(new bitboard_sudoku_solver_static<9>());
+                    break;
+                case 16:
+                    solver.reset(new bitboard_sudoku_solver_static<16>());
+                    break;
+                case 25:
+                    solver.reset(new bitboard_sudoku_solver_static<25>());
+                    break;
+                default:
+                    return vector<vector<vector<int> > >();
+            }
+            solver_width = board.size();
+        }
+        return solver->solve(board, max_solutions);
+    }
+    virtual string name() const {
+        return "bitboard";
+    }
+private:
+    unique_ptr<sudoku_solver> solver;
+    int solver_width = 0;
+};
+
+// Returns a new solver for the backend with the given name ("dlx" or "bitboard"), or NULL if there is no such backend.
+inline sudoku_solver* new_sudoku_solver(const string &backend) {
+    if (backend=="dlx") {
+        return new dlx_sudoku_solver();
+    }
+    if (backend=="bitboard") {
+        return new bitboard_sudoku_solver();
+    }
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,1394 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <atomic>
+#include <set>
+#include <climits>
+#include <sys/resource.h>
+#include "DLX.h"
+#include "SudokuSolver.h"
+
+using namespace std;
+
+/*
+ * This program benchmarks the dancing links solvers on a fixed set of sudoku, n-queens and polyomino problems.
+ * Each case is run several times on the same solver, and the time of each run is summarized along with the
+ * search nodes per second (from the solver's statistics) and the memory used.
+ *
+ * A second table runs sets of randomly generated 16x16 and 25x25 sudokus once each, with the fixed search order
+ * and with randomized order and Luby restarts, and reports the percentiles of their times, which shows the heavy
+ * tail of the fixed order. A third table generates minimal 9x9 and 16x16 puzzles with dlx_sudoku_generator on every
+ * hardware thread and reports the puzzles generated per second. A fourth table builds the polyominoes and the
+ * placement matrix for every free pentomino, hexomino and heptomino, which is the startup cost of a polyomino search.
+ * A fifth table counts the double word squares of 3-digit primes with the exact cover with colors solver. A sixth
+ * table counts the 13-queens solutions with count_parallel on 1 to N threads and reports the speedup over count.
+ * The last table runs consistency checks, whose names start with "check", and the program exits with a status of 1
+ * if any of them fails.
+ *
+ * Usage: DLXBenchmark [repeats] [filter]
+ * repeats: number of timed runs of each case (default 3)
+ * filter: only cases whose name contains this string are run
+ */
+
+// A benchmark case: a solver and a function which runs one search on it and returns the number of solutions.
+struct bench_case {
+	string name;
+	function<dlx_matrix<vector<vector<int> >, vector<vector<int> > >*()> make_solver;
+	function<unsigned long long(dlx_matrix<vector<vector<int> >, vector<vector<int> > >&)> run;
+};
+
+// Reads a sudoku in the format of test_inputs, with 0 for empty cells, and returns it with -1 for empty cells.
+vector<vector<int> > readBoard(const string& file_name) {
+	ifstream fin(file_name);
+	vector<vector<int> > board;
+	string line;
+	while (getline(fin, line) && !line.empty()) {
+		board.push_back(vector<int>());
+		stringstream line_stream(line);
+		int value;
+		while (line_stream >> value) {
+			board.back().push_back(value < 1 ? -1 : value);
+		}
+	}
+	return board;
+}
+
+// Returns a solved sudoku of the given box width built from a fixed pattern, with roughly empty_percent of its
+// cells emptied by a fixed pseudo-random sequence, so that every run of the benchmark gets the same puzzle.
+vector<vector<int> > patternBoard(int box_width, int empty_percent) {
+	int width = box_width * box_width;
+	vector<vector<int> > board(width, vector<int>(width));
+	unsigned int seed = 1;
+	for (int row = 0; row < width; row++) {
+		for (int col = 0; col < width; col++) {
+			board[row][col] = (box_width * (row % box_width) + row / box_width + col) % width + 1;
+			seed = seed * 1103515245u + 12345u;
+			if ((seed >> 16) % 100 < empty_percent) {
+				board[row][col] = -1;
+			}
+		}
+	}
+	return board;
+}
+
+// Returns a sudoku of the given box width made by shuffling the pattern of patternBoard (relabelling the values
+// and permuting the rows and columns within each band and stack) with roughly empty_percent of its cells emptied,
+// all driven by the given seed.
+vector<vector<int> > randomBoard(int box_width, int empty_percent, unsigned int seed) {
+	int width = box_width * box_width;
+	unsigned int state = seed * 2654435761u + 1;
+	auto next_random = [&state]() {
+		state = state * 1103515245u + 12345u;
+		return state >> 8;
+	};
+	vector<int> values(width), rows(width), cols(width);
+	for (int i = 0; i < width; i++) {
+		values[i] = i + 1;
+		rows[i] = i;
+		cols[i] = i;
+	}
+	for (int i = width - 1; i > 0; i--) {
+		swap(values[i], values[next_random() % (i + 1)]);
+	}
+	for (int band = 0; band < box_width; band++) {
+		for (int i = box_width - 1; i > 0; i--) {
+			swap(rows[band * box_width + i], rows[band * box_width + next_random() % (i + 1)]);
+			swap(cols[band * box_width + i], cols[band * box_width + next_random() % (i + 1)]);
+		}
+	}
+	vector<vector<int> > board(width, vector<int>(width));
+	for (int row = 0; row < width; row++) {
+		for (int col = 0; col < width; col++) {
+			board[row][col] = values[(box_width * (rows[row] % box_width) + rows[row] / box_width + cols[col]) % width];
+			if (next_random() % 100 < empty_percent) {
+				board[row][col] = -1;
+			}
+		}
+	}
+	return board;
+}
+
+// Returns the twelve pentominoes.
+vector<polyomino> pentominoes() {
+	vector<vector<pair<int, int> > > shapes = {
+		{{0,0},{1,0},{2,0},{3,0},{4,0}}, // I
+		{{0,0},{0,1},{0,2},{0,3},{1,3}}, // L
+		{{0,0},{0,1},{0,2},{1,2},{1,3}}, // N
+		{{0,0},{1,0},{0,1},{1,1},{0,2}}, // P
+		{{0,0},{1,0},{2,0},{1,1},{1,2}}, // T
+		{{0,0},{2,0},{0,1},{1,1},{2,1}}, // U
+		{{0,0},{0,1},{0,2},{1,2},{2,2}}, // V
+		{{0,0},{0,1},{1,1},{1,2},{2,2}}, // W
+		{{1,0},{0,1},{1,1},{2,1},{1,2}}, // X
+		{{1,0},{0,1},{1,1},{1,2},{1,3}}, // Y
+		{{0,0},{1,0},{1,1},{1,2},{2,2}}, // Z
+		{{1,0},{2,0},{0,1},{1,1},{1,2}}  // F
+	};
+	vector<polyomino> pieces;
+	for (int i = 0; i < shapes.size(); i++) {
+		pieces.push_back(polyomino(shapes[i]));
+	}
+	return pieces;
+}
+
+// Returns the shapes of every free polyomino (distinct up to rotation and reflection) with the given number of
+// blocks, grown one block at a time from the smaller ones. Each shape is kept as the least of its eight images,
+// moved to touch both axes and sorted, so that equal shapes compare equal.
+vector<vector<pair<int, int> > > freePolyominoShapes(int size) {
+	set<vector<pair<int, int> > > shapes = {{{0, 0}}};
+	for (int grown = 1; grown < size; grown++) {
+		set<vector<pair<int, int> > > next_shapes;
+		for (const vector<pair<int, int> >& shape : shapes) {
+			for (int i = 0; i < shape.size(); i++) {
+				for (int direction = 0; direction < 4; direction++) {
+					pair<int, int> block(shape[i].first + (direction == 0) - (direction == 1), shape[i].second + (direction == 2) - (direction == 3));
+					if (find(shape.begin(), shape.end(), block) != shape.end()) {
+						continue;
+					}
+					vector<pair<int, int> > least;
+					for (int symmetry = 0; symmetry < 8; symmetry++) {
+						vector<pair<int, int> > image = shape;
+						image.push_back(block);
+						int min_x = INT_MAX, min_y = INT_MAX;
+						for (int j = 0; j < image.size(); j++) {
+							if (symmetry & 4) {
+								swap(image[j].first, image[j].second);
+							}
+							image[j].first *= (symmetry & 1) ? -1 : 1;
+							image[j].second *= (symmetry & 2) ? -1 : 1;
+							min_x = min(min_x, image[j].first);
+							min_y = min(min_y, image[j].second);
+						}
+						for (int j = 0; j < image.size(); j++) {
+							image[j].first -= min_x;
+							image[j].second -= min_y;
+						}
+						sort(image.begin(), image.end());
+						if (least.empty() || image < least) {
+							least = image;
+						}
+					}
+					next_shapes.insert(least);
+				}
+			}
+		}
+		shapes.swap(next_shapes);
+	}
+	return vector<vector<pair<int, int> > >(shapes.begin(), shapes.end());
+}
+
+// Returns an empty board of width by height cells.
+vector<vector<int> > rectangleBoard(int width, int height) {
+	return vector<vector<int> >(height, vector<int>(width, 0));
+}
+
+// Returns the 8x8 board with the 2x2 square in its centre blocked, which the twelve pentominoes tile exactly.
+vector<vector<int> > centreHoleBoard() {
+	vector<vector<int> > board(8, vector<int>(8, 0));
+	board[3][3] = board[3][4] = board[4][3] = board[4][4] = 1;
+	return board;
+}
+
+// Returns the rows of the exact cover with colors problem whose solutions are the double word squares of primes with
+// the given number of digits: grids whose rows and columns, read left to right and top to bottom, are all distinct
+// primes. The primary columns are the row and column words of the grid, and the secondary columns are its cells,
+// colored by their digit, followed by one uncolored column for each prime so that no prime is used twice.
+vector<vector<pair<int, int> > > primeSquareRows(int digits, int& num_primary, int& num_secondary) {
+	int low = 1;
+	for (int i = 1; i < digits; i++) {
+		low *= 10;
+	}
+	vector<string> primes;
+	for (int value = max(low, 2); value < low * 10; value++) {
+		bool prime = true;
+		for (int divisor = 2; divisor * divisor <= value && prime; divisor++) {
+			prime = value % divisor != 0;
+		}
+		if (prime) {
+			primes.push_back(to_string(value));
+		}
+	}
+	num_primary = 2 * digits;
+	num_secondary = digits * digits + primes.size();
+	vector<vector<pair<int, int> > > rows;
+	for (int word = 0; word < 2 * digits; word++) {
+		for (int i = 0; i < primes.size(); i++) {
+			vector<pair<int, int> > row(1, make_pair(word, 0));
+			for (int j = 0; j < digits; j++) {
+				int cell = (word < digits) ? word * digits + j : j * digits + word - digits;
+				row.push_back(make_pair(num_primary + cell, primes[i][j] - '0' + 1));
+			}
+			row.push_back(make_pair(num_primary + digits * digits + i, 0));
+			rows.push_back(row);
+		}
+	}
+	return rows;
+}
+
+// Returns the peak resident set size of the process in kilobytes.
+long peakMemoryKB() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+vector<bench_case> benchCases() {
+	typedef dlx_matrix<vector<vector<int> >, vector<vector<int> > > solver;
+	vector<bench_case> cases;
+	vector<pair<string, vector<vector<int> > > > sudokus = {
+		{"sudoku 9x9 easy", readBoard("test_inputs/2.txt")},
+		{"sudoku 9x9 17-clue", readBoard("test_inputs/3.txt")},
+		{"sudoku 9x9 hardest", readBoard("test_inputs/1.txt")},
+		{"sudoku 16x16", patternBoard(4, 65)},
+		{"sudoku 25x25", patternBoard(5, 50)}
+	};
+	for (int i = 0; i < sudokus.size(); i++) {
+		vector<vector<int> > board = sudokus[i].second;
+		cases.push_back({sudokus[i].first, [board]() {
+			return new_dlx_matrix_sudoku(board.size());
+		}, [board](solver& matrix) {
+			return (unsigned long long)matrix.solve(board, 1).size();
+		}});
+	}
+	for (int width = 8; width <= 14; width++) {
+		cases.push_back({"n-queens " + to_string(width) + " count", [width]() {
+			return new dlx_matrix_n_queens(width);
+		}, [](solver& matrix) {
+			return matrix.count(vector<vector<int> >());
+		}});
+	}
+	for (int width = 12; width <= 14; width++) {
+		cases.push_back({"n-queens " + to_string(width) + " symmetric", [width]() {
+			return new dlx_matrix_n_queens(width);
+		}, [](solver& matrix) {
+			return static_cast<dlx_matrix_n_queens&>(matrix).count_distinct().total;
+		}});
+	}
+	vector<pair<string, vector<vector<int> > > > pentomino_boards = {
+		{"6x10", rectangleBoard(10, 6)},
+		{"5x12", rectangleBoard(12, 5)},
+		{"3x20", rectangleBoard(20, 3)},
+		{"8x8 hole", centreHoleBoard()}
+	};
+	for (int i = 0; i < pentomino_boards.size(); i++) {
+		vector<vector<int> > board = pentomino_boards[i].second;
+		int width = board[0].size();
+		int height = board.size();
+		cases.push_back({"pentomino " + pentomino_boards[i].first + " count", [width, height]() {
+			return new dlx_matrix_polyomino(pentominoes(), width, height);
+		}, [board](solver& matrix) {
+			return matrix.count(board);
+		}});
+		cases.push_back({"pentomino " + pentomino_boards[i].first + " symmetric", [width, height]() {
+			return new dlx_matrix_polyomino(pentominoes(), width, height);
+		}, [board](solver& matrix) {
+			return static_cast<dlx_matrix_polyomino&>(matrix).count_distinct(board).total;
+		}});
+		cases.push_back({"pentomino " + pentomino_boards[i].first + " pruned", [width, height]() {
+			dlx_matrix_polyomino* matrix = new dlx_matrix_polyomino(pentominoes(), width, height);
+			matrix->prune_dead_regions = true;
+			return matrix;
+		}, [board](solver& matrix) {
+			return static_cast<dlx_matrix_polyomino&>(matrix).count_distinct(board).total;
+		}});
+	}
+	// identical L-trominoes as separate polyominoes, which finds each tiling once per ordering of the copies, and
+	// as copies of one polyomino, which finds it once
+	polyomino l_tromino({{0, 0}, {0, 1}, {1, 1}});
+	cases.push_back({"L-tromino 4x6 distinct", [l_tromino]() {
+		return new dlx_matrix_polyomino(vector<polyomino>(8, l_tromino), 6, 4);
+	}, [](solver& matrix) {
+		return matrix.count(vector<vector<int> >());
+	}});
+	vector<pair<int, int> > tromino_rectangles = {{6, 4}, {9, 8}};
+	for (int i = 0; i < tromino_rectangles.size(); i++) {
+		int width = tromino_rectangles[i].first;
+		int height = tromino_rectangles[i].second;
+		cases.push_back({"L-tromino " + to_string(height) + "x" + to_string(width) + " copies", [l_tromino, width, height]() {
+			return new dlx_matrix_polyomino(vector<polyomino>(1, l_tromino), width, height, vector<int>(1, width * height / 3));
+		}, [](solver& matrix) {
+			return matrix.count(vector<vector<int> >());
+		}});
+	}
+	return cases;
+}
+
+// Returns the nearest-rank percentile (fraction from 0 to 1) of the given sorted values.
+double percentile(const vector<double>& sorted_values, double fraction) {
+	int rank = max((int)ceil(fraction * sorted_values.size()) - 1, 0);
+	return sorted_values[rank];
+}
+
+// Solves count random puzzles of the given box width once each and prints the percentiles of their times.
+// Each search is stopped after max_attempts so that the fixed order cannot run for too long on a bad puzzle,
+// and the number stopped is reported.
+void runTailCase(const string& name, int box_width, int empty_percent, int count, bool randomized, long long max_attempts) {
+	unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > matrix(new_dlx_matrix_sudoku(box_width * box_width));
+	matrix->limits.max_attempts = max_attempts;
+	// the stopped puzzles are counted from the search status below instead of printed by solve
+	matrix->quiet = true;
+	if (randomized) {
+		matrix->randomization.restarts = dlx_restart_schedule::luby;
+	}
+	vector<double> times;
+	int stopped = 0;
+	long long restarts = 0;
+	for (int i = 1; i <= count; i++) {
+		vector<vector<int> > board = randomBoard(box_width, empty_percent, i);
+		if (randomized) {
+			matrix->randomization.seed = i;
+		}
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		matrix->solve(board, 1);
+		times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+		stopped += matrix->last_search().status != dlx_search_status::completed;
+		restarts += matrix->last_search().restarts;
+	}
+	sort(times.begin(), times.end());
+	printf("%-34s %8d %10.3f %10.3f %10.3f %10.3f %8d %10lld\n", name.c_str(), count, percentile(times, 0.5), percentile(times, 0.9), percentile(times, 0.99), times.back(), stopped, restarts);
+	fflush(stdout);
+}
+
+// Generates count minimal puzzles of the given width and prints the rate and the mean number of clues.
+void runGeneratorCase(const string& name, int width, int count) {
+	dlx_sudoku_generator generator;
+	generator.reserve(width);
+	dlx_sudoku_generator::generator_result result = generator.generate(width, count);
+	double mean_clues = 0;
+	for (int i = 0; i < count; i++) {
+		mean_clues += (double)result.puzzles[i].clues / count;
+	}
+	printf("%-34s %8d %8u %12.2f %10.1f\n", name.c_str(), count, max(thread::hardware_concurrency(), 1u), result.puzzles_per_second, mean_clues);
+	fflush(stdout);
+}
+
+// Builds the polyominoes of every free polyomino shape with the given number of blocks and a matrix placing them
+// on the smallest square board with room for all of them, repeats times, and prints the fastest time of each step.
+void runPolyominoGenerationCase(const string& name, int size, int repeats) {
+	vector<vector<pair<int, int> > > shapes = freePolyominoShapes(size);
+	int side = (int)ceil(sqrt((double)size * shapes.size()));
+	double shapes_ms = 0, matrix_ms = 0;
+	int orientations = 0;
+	size_t matrix_kb = 0;
+	for (int run = 0; run < repeats; run++) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		vector<polyomino> pieces;
+		for (int i = 0; i < shapes.size(); i++) {
+			pieces.push_back(polyomino(shapes[i]));
+		}
+		chrono::steady_clock::time_point shapes_end = chrono::steady_clock::now();
+		dlx_matrix_polyomino matrix(pieces, side);
+		chrono::steady_clock::time_point matrix_end = chrono::steady_clock::now();
+		double run_shapes_ms = chrono::duration<double, milli>(shapes_end - start).count();
+		double run_matrix_ms = chrono::duration<double, milli>(matrix_end - shapes_end).count();
+		shapes_ms = (run == 0) ? run_shapes_ms : min(shapes_ms, run_shapes_ms);
+		matrix_ms = (run == 0) ? run_matrix_ms : min(matrix_ms, run_matrix_ms);
+		orientations = 0;
+		for (int i = 0; i < pieces.size(); i++) {
+			orientations += pieces[i].getOrientations();
+		}
+		matrix_kb = matrix.matrix_memory() / 1024;
+	}
+	printf("%-34s %8zu %8d %8d %10.3f %10.3f %10zu\n", name.c_str(), shapes.size(), orientations, side, shapes_ms, matrix_ms, matrix_kb);
+	fflush(stdout);
+}
+
+// Counts the double word squares of primes with the given number of digits repeats times with dlx_matrix_xcc, whose
+// crossing words share a cell through its color, and prints the same columns as the first table.
+void runColorCase(const string& name, int digits, int repeats) {
+	int num_primary, num_secondary;
+	vector<vector<pair<int, int> > > rows = primeSquareRows(digits, num_primary, num_secondary);
+	dlx_matrix_xcc matrix(num_primary, num_secondary, rows);
+	vector<double> times;
+	vector<double> node_rates;
+	unsigned long long solutions = 0;
+	for (int run = 0; run < repeats; run++) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		solutions = matrix.count(vector<int>());
+		times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+		const dlx_search_stats& stats = matrix.last_search();
+		if (stats.search_us > 0) {
+			node_rates.push_back(stats.attempts / (stats.search_us / 1e6));
+		}
+	}
+	sort(times.begin(), times.end());
+	sort(node_rates.begin(), node_rates.end());
+	double node_rate = node_rates.empty() ? 0 : node_rates[node_rates.size() / 2];
+	double median = (times[(repeats - 1) / 2] + times[repeats / 2]) / 2;
+	printf("%-26s %10llu %10.3f %10.3f %8d %12.0f %10zu %10ld\n", name.c_str(), solutions, times[0], median, repeats, node_rate, matrix.matrix_memory() / 1024, peakMemoryKB());
+	fflush(stdout);
+}
+
+// Counts the n-queens solutions for the given width with count and then with count_parallel on 1, 2, 4, ... threads
+// up to the number of hardware threads (and at least 4), and prints the fastest of repeats runs of each with its
+// speedup over count.
+void runScalingCase(const string& name, int width, int repeats) {
+	dlx_matrix_n_queens matrix(width);
+	vector<int> thread_counts;
+	int hardware_threads = max((int)thread::hardware_concurrency(), 1);
+	for (int threads = 1; threads <= max(hardware_threads, 4); threads *= 2) {
+		thread_counts.push_back(threads);
+	}
+	if (thread_counts.back() != hardware_threads && hardware_threads > 4) {
+		thread_counts.push_back(hardware_threads);
+	}
+	double serial_ms = 0;
+	unsigned long long solutions = 0;
+	for (int i = -1; i < (int)thread_counts.size(); i++) {
+		double best_ms = 0;
+		for (int run = 0; run < repeats; run++) {
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			solutions = (i == -1) ? matrix.count(vector<vector<int> >()) : matrix.count_parallel(vector<vector<int> >(), thread_counts[i]);
+			double run_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			best_ms = (run == 0) ? run_ms : min(best_ms, run_ms);
+		}
+		if (i == -1) {
+			serial_ms = best_ms;
+			printf("%-26s %8s %10llu %10.3f %8.2f\n", name.c_str(), "serial", solutions, best_ms, 1.0);
+		}
+		else {
+			printf("%-26s %8d %10llu %10.3f %8.2f\n", name.c_str(), thread_counts[i], solutions, best_ms, serial_ms / best_ms);
+		}
+		fflush(stdout);
+	}
+}
+
+// A check case: a function which runs the solvers on a set of problems, comparing their results with another solver
+// or with what is known about the problems, and returns the number of problems checked. It sets failure to a
+// description of the first mismatch, if any.
+struct check_case {
+	string name;
+	function<int(string&)> run;
+};
+
+// Solves count random puzzles of the given box width twice, once with a solver which is reused for all of them and
+// once with a fresh solver, and checks that the results and search statuses are identical. The puzzles mix the
+// paths by which a search can end: running to completion, reaching max_solutions, being stopped by an attempt
+// limit, and being rejected because two givens conflict.
+int checkReuse(function<dlx_matrix<vector<vector<int> >, vector<vector<int> > >*()> make_solver, int box_width, int count, string& failure) {
+	unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > reused(make_solver());
+	reused->quiet = true;
+	int max_solutions[] = {1, 2, 10};
+	for (int i = 1; i <= count; i++) {
+		vector<vector<int> > board = randomBoard(box_width, 40 + i % 40, i);
+		if (i % 5 == 0) {
+			board[0][1] = board[0][0] = max(board[0][0], 1);
+		}
+		unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > fresh(make_solver());
+		fresh->quiet = true;
+		long long max_attempts = (i % 7 == 0) ? 5 : -1;
+		reused->limits.max_attempts = max_attempts;
+		fresh->limits.max_attempts = max_attempts;
+		vector<vector<vector<int> > > reused_solutions = reused->solve(board, max_solutions[i % 3]);
+		vector<vector<vector<int> > > fresh_solutions = fresh->solve(board, max_solutions[i % 3]);
+		if (reused_solutions != fresh_solutions || reused->last_search().status != fresh->last_search().status) {
+			failure = "puzzle " + to_string(i) + " differs from a fresh solver";
+			return i;
+		}
+	}
+	return count;
+}
+
+// Solves a batch of random 4x4, 9x9 and 16x16 puzzles with dlx_sudoku_batch on several threads, along with boards
+// whose givens conflict or have been changed and boards which are not valid sudokus, and checks each solution and outcome against a
+// single solver (conflicting givens make a board invalid, as the solver rejects them before searching).
+int checkBatch(string& failure) {
+	vector<vector<vector<int> > > boards;
+	for (int i = 1; i <= 600; i++) {
+		vector<vector<int> > board = randomBoard(2 + i % 3, 40 + i % 30, i);
+		if (i % 9 == 0) {
+			board[0][1] = board[0][0] = max(board[0][0], 1);
+		}
+		// a changed clue which conflicts with no other clue can leave a valid board with no solution
+		if (i % 9 == 4 && board[1][1] != -1) {
+			board[1][1] = board[1][1] % board.size() + 1;
+		}
+		if (i % 50 == 0) {
+			board[0][0] = board.size() + 1;
+		}
+		boards.push_back(board);
+	}
+	boards.push_back(vector<vector<int> >(5, vector<int>(5, -1)));
+	boards.push_back(vector<vector<int> >());
+	dlx_sudoku_batch batch(3);
+	dlx_sudoku_batch::batch_result result = batch.solve(boards);
+	for (int i = 0; i < boards.size(); i++) {
+		dlx_batch_outcome expected = dlx_batch_outcome::invalid;
+		vector<vector<int> > solution;
+		int width = boards[i].size();
+		bool in_range = width == 4 || width == 9 || width == 16;
+		for (int row = 0; row < width && in_range; row++) {
+			for (int col = 0; col < width; col++) {
+				in_range = in_range && boards[i][row][col] <= width;
+			}
+		}
+		if (in_range) {
+			unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > solver(new_dlx_matrix_sudoku(width));
+			solver->quiet = true;
+			vector<vector<vector<int> > > solutions = solver->solve(boards[i], 1);
+			if (!solutions.empty()) {
+				expected = dlx_batch_outcome::solved;
+				solution = solutions[0];
+			}
+			else if (solver->last_search().status != dlx_search_status::invalid_input) {
+				expected = dlx_batch_outcome::no_solution;
+			}
+		}
+		if (result.outcomes[i] != expected || result.solutions[i] != solution) {
+			failure = "board " + to_string(i) + " differs from a single solver";
+			return i + 1;
+		}
+	}
+	return boards.size();
+}
+
+// Solves count random puzzles of the given box width with dlx_matrix_sudoku_static and with the runtime-width
+// dlx_matrix_sudoku, and checks that they find the same solutions in the same order. Boards with a clue outside 1 to
+// N must be rejected as invalid input.
+template<int N>
+int checkStatic(int box_width, int count, string& failure) {
+	dlx_matrix_sudoku_static<N> static_solver;
+	dlx_matrix_sudoku runtime_solver(N);
+	static_solver.quiet = true;
+	runtime_solver.quiet = true;
+	for (int i = 1; i <= count; i++) {
+		vector<vector<int> > board = randomBoard(box_width, 40 + i % 40, i);
+		if (static_solver.solve(board, 10) != runtime_solver.solve(board, 10)) {
+			failure = "puzzle " + to_string(i) + " differs between the solvers";
+			return i;
+		}
+	}
+	// clues outside 1 to N must be rejected before the search, rather than fixing some other row of the matrix
+	int bad_values[] = {0, N + 1};
+	for (int i = 0; i < 2; i++) {
+		vector<vector<int> > board(N, vector<int>(N, -1));
+		board[N - 1][N - 1] = bad_values[i];
+		if (!static_solver.solve(board, 1).empty() || static_solver.last_search().status != dlx_search_status::invalid_input) {
+			failure = "a clue of " + to_string(bad_values[i]) + " is not rejected";
+			return count + i + 1;
+		}
+	}
+	return count + 2;
+}
+
+// Returns whether solution is a filled sudoku which keeps the givens of board and repeats no value in a row, column
+// or box.
+bool isSudokuSolution(const vector<vector<int> >& board, const vector<vector<int> >& solution) {
+	int width = board.size();
+	int box_width = (int)round(sqrt(width));
+	if (solution.size() != width) {
+		return false;
+	}
+	for (int row = 0; row < width; row++) {
+		for (int col = 0; col < width; col++) {
+			int value = solution[row][col];
+			if (value < 1 || value > width || (board[row][col] != -1 && board[row][col] != value)) {
+				return false;
+			}
+			for (int other = 0; other < width; other++) {
+				int box_row = row / box_width * box_width + other / box_width;
+				int box_col = col / box_width * box_width + other % box_width;
+				if ((other != col && solution[row][other] == value) || (other != row && solution[other][col] == value) || ((box_row != row || box_col != col) && solution[box_row][box_col] == value)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Solves the test inputs of the given width and count random puzzles, with conflicting or changed givens mixed in
+// above 1x1, with the bitboard backend and with dancing links, and checks that they find the same number of solutions
+// (up to 10). When there are fewer than 10 the solutions must be the same, and otherwise every solution the bitboard backend
+// finds must be valid, as the two solvers search in different orders. verify_unique on either backend must agree with
+// the number of solutions dancing links finds, and give one of its solutions.
+int checkBitboard(int box_width, int count, string& failure) {
+	int width = box_width * box_width;
+	vector<vector<vector<int> > > boards;
+	for (int i = 0; i < 5; i++) {
+		vector<vector<int> > board = readBoard("test_inputs/" + to_string(i) + ".txt");
+		if (board.size() == width) {
+			boards.push_back(board);
+		}
+	}
+	for (int i = 1; i <= count; i++) {
+		vector<vector<int> > board = randomBoard(box_width, 40 + i % 40, i);
+		if (i % 9 == 0 && width > 1) {
+			board[0][1] = board[0][0] = max(board[0][0], 1);
+		}
+		if (i % 9 == 4 && width > 1 && board[1][1] != -1) {
+			board[1][1] = board[1][1] % width + 1;
+		}
+		boards.push_back(board);
+	}
+	bitboard_sudoku_solver bitboard;
+	unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > dlx(new_dlx_matrix_sudoku(width));
+	dlx->quiet = true;
+	for (int i = 0; i < boards.size(); i++) {
+		vector<vector<vector<int> > > bitboard_solutions = bitboard.solve(boards[i], 10);
+		vector<vector<vector<int> > > dlx_solutions = dlx->solve(boards[i], 10);
+		bool same = bitboard_solutions.size() == dlx_solutions.size();
+		if (same && dlx_solutions.size() < 10) {
+			sort(bitboard_solutions.begin(), bitboard_solutions.end());
+			sort(dlx_solutions.begin(), dlx_solutions.end());
+			same = bitboard_solutions == dlx_solutions;
+		}
+		for (int j = 0; j < bitboard_solutions.size() && same; j++) {
+			same = isSudokuSolution(boards[i], bitboard_solutions[j]);
+		}
+		if (!same) {
+			failure = "board " + to_string(i) + " differs from dancing links";
+			return i + 1;
+		}
+		dlx_uniqueness expected = dlx_solutions.empty() ? dlx_uniqueness::none : (dlx_solutions.size() == 1) ? dlx_uniqueness::unique : dlx_uniqueness::multiple;
+		vector<vector<int> > first_solution;
+		if (dlx->verify_unique(boards[i], &first_solution) != expected || bitboard.verify_unique(boards[i]) != expected || (!dlx_solutions.empty() && find(dlx_solutions.begin(), dlx_solutions.end(), first_solution) == dlx_solutions.end())) {
+			failure = "board " + to_string(i) + " has the wrong answer from verify_unique";
+			return i + 1;
+		}
+	}
+	return boards.size();
+}
+
+// Generates count puzzles of the given width on two threads and checks that each has a unique solution, which is
+// the one the generator reports, and is minimal, every clue being needed. The puzzles must also be the same when
+// generated on one thread.
+int checkGenerator(int width, int count, string& failure) {
+	dlx_sudoku_generator generator(2);
+	dlx_sudoku_generator single_thread_generator(1);
+	vector<dlx_sudoku_generator::generated_puzzle> puzzles = generator.generate(width, count, 7).puzzles;
+	vector<dlx_sudoku_generator::generated_puzzle> single_thread_puzzles = single_thread_generator.generate(width, count, 7).puzzles;
+	unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > solver(new_dlx_matrix_sudoku(width));
+	solver->quiet = true;
+	for (int i = 0; i < count; i++) {
+		vector<vector<int> > puzzle = puzzles[i].puzzle;
+		int clues = 0;
+		for (int cell = 0; cell < width * width; cell++) {
+			clues += puzzle[cell / width][cell % width] != -1;
+		}
+		vector<vector<vector<int> > > solutions = solver->solve(puzzle, 2);
+		if (puzzle != single_thread_puzzles[i].puzzle || clues != puzzles[i].clues || solutions.size() != 1 || solutions[0] != puzzles[i].solution) {
+			failure = "puzzle " + to_string(i) + " is not unique or does not match its solution";
+			return i + 1;
+		}
+		for (int cell = 0; cell < width * width; cell++) {
+			int value = puzzle[cell / width][cell % width];
+			puzzle[cell / width][cell % width] = -1;
+			if (value != -1 && solver->solve(puzzle, 2).size() != 2) {
+				failure = "puzzle " + to_string(i) + " is not minimal";
+				return i + 1;
+			}
+			puzzle[cell / width][cell % width] = value;
+		}
+	}
+	return count;
+}
+
+// Returns the solutions of an exact cover problem with colors, in increasing order, found by trying every set of rows
+// which includes the given ones, for checking dlx_matrix_xcc on small problems. Only the given rows may leave every primary column
+// uncovered, as the solver chooses all other rows through a primary column.
+vector<vector<int> > bruteForceColorSolutions(int num_primary, int num_secondary, const vector<vector<pair<int, int> > >& rows, const vector<int>& given) {
+	vector<vector<int> > solutions;
+	for (int subset = 0; subset < (1 << rows.size()); subset++) {
+		vector<int> covers(num_primary + num_secondary, 0);
+		vector<int> colors(num_primary + num_secondary, -1);
+		bool valid = true;
+		for (int i = 0; i < given.size(); i++) {
+			valid = valid && ((subset >> given[i]) & 1);
+		}
+		for (int row = 0; row < rows.size() && valid; row++) {
+			if (!((subset >> row) & 1)) {
+				continue;
+			}
+			bool has_primary = false;
+			for (int i = 0; i < rows[row].size(); i++) {
+				int column = rows[row][i].first;
+				int color = rows[row][i].second;
+				has_primary = has_primary || column < num_primary;
+				// a color of 0 needs the column to itself, while a color may be shared by rows which agree on it
+				valid = valid && (colors[column] == -1 || (color > 0 && colors[column] == color));
+				colors[column] = color;
+				covers[column]++;
+			}
+			valid = valid && (has_primary || find(given.begin(), given.end(), row) != given.end());
+		}
+		for (int column = 0; column < num_primary && valid; column++) {
+			valid = covers[column] == 1;
+		}
+		if (valid) {
+			solutions.push_back(vector<int>());
+			for (int row = 0; row < rows.size(); row++) {
+				if ((subset >> row) & 1) {
+					solutions.back().push_back(row);
+				}
+			}
+		}
+	}
+	sort(solutions.begin(), solutions.end());
+	return solutions;
+}
+
+// Solves exact cover problems with colors with dlx_matrix_xcc and compares their solutions with bruteForceColorSolutions.
+// The first problem has a given row whose only column is colored, which must leave the column to the rows that agree
+// on its color, and the rest are count random problems with up to 10 rows, some of them with given rows.
+int checkColors(int count, string& failure) {
+	vector<vector<pair<int, int> > > shared_rows = {{{2, 1}}, {{0, 0}, {2, 1}}, {{1, 0}, {2, 1}}, {{0, 0}, {1, 0}}};
+	vector<vector<int> > shared_givens = {{}, {0}, {1}, {0, 3}};
+	for (int i = 0; i < shared_givens.size(); i++) {
+		dlx_matrix_xcc matrix(2, 1, shared_rows);
+		matrix.quiet = true;
+		vector<vector<int> > solutions = matrix.solve(shared_givens[i], -1);
+		sort(solutions.begin(), solutions.end());
+		if (solutions != bruteForceColorSolutions(2, 1, shared_rows, shared_givens[i])) {
+			failure = "the shared color problem with given set " + to_string(i) + " has the wrong solutions";
+			return i + 1;
+		}
+	}
+	unsigned int state = 1;
+	auto next_random = [&state](int limit) {
+		state = state * 1103515245u + 12345u;
+		return (int)((state >> 8) % limit);
+	};
+	for (int i = 1; i <= count; i++) {
+		int num_primary = 1 + next_random(4);
+		int num_secondary = next_random(4);
+		int num_colors = 1 + next_random(3);
+		vector<vector<pair<int, int> > > rows(1 + next_random(10));
+		for (int row = 0; row < rows.size(); row++) {
+			for (int column = 0; column < num_primary + num_secondary; column++) {
+				if (next_random(3) == 0) {
+					rows[row].push_back(make_pair(column, (column < num_primary) ? 0 : next_random(num_colors + 1)));
+				}
+			}
+			if (rows[row].empty()) {
+				rows[row].push_back(make_pair(next_random(num_primary), 0));
+			}
+		}
+		vector<int> given;
+		if (next_random(3) == 0) {
+			given.push_back(next_random(rows.size()));
+		}
+		dlx_matrix_xcc matrix(num_primary, num_secondary, rows);
+		matrix.quiet = true;
+		vector<vector<int> > solutions = matrix.solve(given, -1);
+		sort(solutions.begin(), solutions.end());
+		if (solutions != bruteForceColorSolutions(num_primary, num_secondary, rows, given)) {
+			failure = "random problem " + to_string(i) + " has the wrong solutions";
+			return shared_givens.size() + i;
+		}
+	}
+	return shared_givens.size() + count;
+}
+
+// Counts the n-queens solutions for N=1 to 12 with count_distinct and compares the totals and the numbers distinct up
+// to rotation and reflection with the known values, and the totals with count. On the 1x1 board all eight symmetries
+// fix the single solution, which must still be counted once.
+int checkQueensDistinct(string& failure) {
+	unsigned long long known_totals[] = {1, 0, 0, 2, 10, 4, 40, 92, 352, 724, 2680, 14200};
+	unsigned long long known_distinct[] = {1, 0, 0, 1, 2, 1, 6, 12, 46, 92, 341, 1787};
+	for (int width = 1; width <= 12; width++) {
+		dlx_matrix_n_queens matrix(width);
+		matrix.quiet = true;
+		dlx_matrix_n_queens::symmetry_counts counts = matrix.count_distinct();
+		if (counts.total != known_totals[width - 1] || counts.distinct != known_distinct[width - 1] || counts.total != matrix.count(vector<vector<int> >())) {
+			failure = to_string(width) + "-queens has " + to_string(counts.total) + " solutions, " + to_string(counts.distinct) + " distinct";
+			return width;
+		}
+	}
+	return 12;
+}
+
+// Counts the pentomino tilings of the 6x10, 5x12 and 3x20 rectangles and the 8x8 board with a hole in its centre with
+// count_distinct, and compares the tilings distinct up to the board's symmetries with the known values, and the totals
+// with count. The distinct tilings are counted again with prune_dead_regions set, which must not change them.
+int checkPentominoes(string& failure) {
+	vector<vector<vector<int> > > boards = {rectangleBoard(10, 6), rectangleBoard(12, 5), rectangleBoard(20, 3), centreHoleBoard()};
+	unsigned long long known_distinct[] = {2339, 1010, 2, 65};
+	for (int i = 0; i < boards.size(); i++) {
+		dlx_matrix_polyomino matrix(pentominoes(), boards[i][0].size(), boards[i].size());
+		matrix.quiet = true;
+		dlx_matrix_polyomino::symmetry_counts counts = matrix.count_distinct(boards[i]);
+		unsigned long long total = matrix.count(boards[i]);
+		if (counts.reduced != known_distinct[i] || counts.total != total) {
+			failure = "board " + to_string(i) + " has " + to_string(counts.reduced) + " distinct tilings and " + to_string(counts.total) + " of " + to_string(total) + " in total";
+			return i + 1;
+		}
+		matrix.prune_dead_regions = true;
+		if (matrix.count_distinct(boards[i]).reduced != counts.reduced) {
+			failure = "board " + to_string(i) + " has a different number of tilings when pruned";
+			return i + 1;
+		}
+	}
+	return boards.size();
+}
+
+// Counts the L-tromino tilings of the 4x6 and 8x9 rectangles and of a 6x6 board with three blocked cells, with the
+// trominoes as copies of one polyomino, with and without prune_dead_regions, which must find the same tilings. The
+// blocked cells leave pockets whose area is not a multiple of 3, which pruning must reject.
+int checkPruning(string& failure) {
+	polyomino l_tromino({{0, 0}, {0, 1}, {1, 1}});
+	vector<vector<vector<int> > > boards = {rectangleBoard(6, 4), rectangleBoard(9, 8), rectangleBoard(6, 6)};
+	boards[2][0][3] = boards[2][3][3] = boards[2][4][2] = 1;
+	for (int i = 0; i < boards.size(); i++) {
+		int width = boards[i][0].size();
+		int height = boards[i].size();
+		int open_cells = 0;
+		for (int row = 0; row < height; row++) {
+			for (int col = 0; col < width; col++) {
+				open_cells += boards[i][row][col] == 0;
+			}
+		}
+		dlx_matrix_polyomino matrix(vector<polyomino>(1, l_tromino), width, height, vector<int>(1, open_cells / 3));
+		matrix.quiet = true;
+		unsigned long long unpruned = matrix.count(boards[i]);
+		matrix.prune_dead_regions = true;
+		unsigned long long pruned = matrix.count(boards[i]);
+		if (pruned != unpruned || unpruned == 0 || (i == 2 && matrix.last_search().pruned == 0)) {
+			failure = "board " + to_string(i) + " has " + to_string(pruned) + " tilings when pruned and " + to_string(unpruned) + " otherwise";
+			return i + 1;
+		}
+	}
+	return boards.size();
+}
+
+// Counts the L-tromino tilings of 4x6 and 6x6 rectangles with the trominoes as copies of one polyomino, whose shared
+// column finds each tiling once, and of the 4x6 rectangle with eight separate L-trominoes, which finds each tiling
+// once for every ordering of them, so that its count must be the first times 8!. The 6x6 count must be the known 162.
+int checkCopies(string& failure) {
+	polyomino l_tromino({{0, 0}, {0, 1}, {1, 1}});
+	vector<pair<int, int> > rectangles = {{6, 4}, {6, 6}};
+	vector<unsigned long long> copies_counts;
+	for (int i = 0; i < rectangles.size(); i++) {
+		int width = rectangles[i].first;
+		int height = rectangles[i].second;
+		dlx_matrix_polyomino matrix(vector<polyomino>(1, l_tromino), width, height, vector<int>(1, width * height / 3));
+		matrix.quiet = true;
+		copies_counts.push_back(matrix.count(rectangleBoard(width, height)));
+	}
+	dlx_matrix_polyomino separate(vector<polyomino>(8, l_tromino), 6, 4);
+	separate.quiet = true;
+	unsigned long long separate_count = separate.count(rectangleBoard(6, 4));
+	unsigned long long orderings = 1;
+	for (int copies = 2; copies <= 8; copies++) {
+		orderings *= copies;
+	}
+	if (copies_counts[0] == 0 || copies_counts[0] * orderings != separate_count) {
+		failure = "4x6 has " + to_string(copies_counts[0]) + " tilings with copies and " + to_string(separate_count) + " with separate pieces";
+		return 1;
+	}
+	if (copies_counts[1] != 162) {
+		failure = "6x6 has " + to_string(copies_counts[1]) + " tilings";
+		return 2;
+	}
+	return 2;
+}
+
+// Reads one JSON value from text starting at pos, moving pos past it, and returns whether it is well formed. Only the
+// values to_json writes are accepted: objects, arrays, strings without escapes and numbers.
+bool readJsonValue(const string& text, size_t& pos) {
+	if (pos >= text.size()) {
+		return false;
+	}
+	if (text[pos] == '"') {
+		size_t end = text.find('"', pos + 1);
+		pos = end + 1;
+		return end != string::npos;
+	}
+	if (text[pos] == '{' || text[pos] == '[') {
+		char close = (text[pos] == '{') ? '}' : ']';
+		bool is_object = close == '}';
+		pos++;
+		if (pos < text.size() && text[pos] == close) {
+			pos++;
+			return true;
+		}
+		while (true) {
+			if (is_object && (!readJsonValue(text, pos) || text[pos - 1] != '"' || pos >= text.size() || text[pos++] != ':')) {
+				return false;
+			}
+			if (!readJsonValue(text, pos) || pos >= text.size()) {
+				return false;
+			}
+			if (text[pos] == close) {
+				pos++;
+				return true;
+			}
+			if (text[pos++] != ',') {
+				return false;
+			}
+		}
+	}
+	const char* start = text.c_str() + pos;
+	char* end;
+	strtod(start, &end);
+	pos += end - start;
+	return end != start;
+}
+
+// Returns whether text is a single well formed JSON object with every field of dlx_search_stats and the given status.
+bool isStatsJson(const string& text, dlx_search_status status) {
+	size_t pos = 0;
+	if (text.empty() || text[0] != '{' || !readJsonValue(text, pos) || pos != text.size()) {
+		return false;
+	}
+	vector<string> fields = {"status", "solutions", "attempts", "backtracks", "restarts", "pruned", "link_updates", "max_depth", "depth_choices", "depth_rows", "generation_us", "initialize_us", "search_us", "interpret_us"};
+	for (int i = 0; i < fields.size(); i++) {
+		if (text.find("\"" + fields[i] + "\":") == string::npos) {
+			return false;
+		}
+	}
+	return text.find("\"status\":\"" + string(dlx_search_status_name(status)) + "\"") != string::npos;
+}
+
+// Runs the 10-queens search (724 solutions) under each of the search limits and checks that each stops it with the
+// right status: a solution limit and no limit complete it, an attempt budget, a deadline which has passed and a
+// cancellation flag stop it early, and a flag set from another thread stops a search which would run for a long time.
+// The statistics of each search, and of one rejected as invalid input, must be well formed JSON with that status.
+int checkLimits(string& failure) {
+	typedef dlx_matrix<vector<vector<int> >, vector<vector<int> > > solver;
+	struct limit_case {
+		string name;
+		function<void(solver&)> set_limits;
+		int max_solutions;
+		dlx_search_status status;
+	};
+	atomic<bool> cancelled(true);
+	vector<limit_case> limit_cases = {
+		{"no limit", [](solver& matrix) {}, -1, dlx_search_status::completed},
+		{"max_solutions", [](solver& matrix) {}, 5, dlx_search_status::completed},
+		{"max_attempts", [](solver& matrix) {
+			matrix.limits.max_attempts = 100;
+		}, -1, dlx_search_status::attempt_limit_reached},
+		{"deadline", [](solver& matrix) {
+			matrix.limits.deadline = chrono::steady_clock::now() - chrono::milliseconds(1);
+		}, -1, dlx_search_status::timed_out},
+		{"cancel", [&cancelled](solver& matrix) {
+			matrix.limits.cancel = &cancelled;
+		}, -1, dlx_search_status::cancelled}
+	};
+	for (int i = 0; i < limit_cases.size(); i++) {
+		dlx_matrix_n_queens matrix(10);
+		matrix.quiet = true;
+		limit_cases[i].set_limits(matrix);
+		int found = matrix.solve(vector<vector<int> >(), limit_cases[i].max_solutions).size();
+		const dlx_search_stats& stats = matrix.last_search();
+		int expected = (limit_cases[i].max_solutions == -1) ? 724 : limit_cases[i].max_solutions;
+		bool stopped_early = limit_cases[i].status != dlx_search_status::completed;
+		if (stats.status != limit_cases[i].status || (stopped_early ? found >= 724 : found != expected) || (i == 2 && stats.attempts < 100) || !isStatsJson(stats.to_json(), stats.status)) {
+			failure = limit_cases[i].name + " ended as " + dlx_search_status_name(stats.status) + " with " + to_string(found) + " solutions";
+			return i + 1;
+		}
+	}
+	dlx_matrix_n_queens long_search(16);
+	atomic<bool> cancel_later(false);
+	long_search.limits.cancel = &cancel_later;
+	thread canceller([&cancel_later]() {
+		this_thread::sleep_for(chrono::milliseconds(20));
+		cancel_later = true;
+	});
+	long_search.count(vector<vector<int> >());
+	canceller.join();
+	if (long_search.last_search().status != dlx_search_status::cancelled || !isStatsJson(long_search.last_search().to_json(), dlx_search_status::cancelled)) {
+		failure = "a search cancelled from another thread ended as " + string(dlx_search_status_name(long_search.last_search().status));
+		return limit_cases.size() + 1;
+	}
+	dlx_matrix_sudoku_static<4> sudoku;
+	sudoku.quiet = true;
+	sudoku.solve(vector<vector<int> >(3, vector<int>(3, -1)), 1);
+	if (!isStatsJson(sudoku.last_search().to_json(), dlx_search_status::invalid_input)) {
+		failure = "the statistics of a rejected search are not well formed: " + sudoku.last_search().to_json();
+		return limit_cases.size() + 2;
+	}
+	// restart settings whose budgets would be 0 or never grow are raised to ones that let the search finish, which a
+	// 9x9 sudoku with no solution and a search tree of many nodes needs (the deadline only turns a hang into a failure)
+	unique_ptr<solver> unsolvable(new_dlx_matrix_sudoku(9));
+	unsolvable->quiet = true;
+	vector<vector<int> > board;
+	for (int i = 1; board.empty(); i++) {
+		vector<vector<int> > candidate = randomBoard(3, 60, i);
+		if (candidate[1][1] != -1) {
+			candidate[1][1] = candidate[1][1] % 9 + 1;
+			if (unsolvable->solve(candidate, 1).empty() && unsolvable->last_search().status == dlx_search_status::completed && unsolvable->last_search().attempts >= 50) {
+				board = candidate;
+			}
+		}
+	}
+	vector<pair<dlx_restart_schedule, pair<long long, double> > > restart_settings = {{dlx_restart_schedule::luby, {0, 1.5}}, {dlx_restart_schedule::luby, {-5, 1.5}}, {dlx_restart_schedule::geometric, {0, 1.5}}, {dlx_restart_schedule::geometric, {1, 0.5}}, {dlx_restart_schedule::geometric, {1, 1.0}}};
+	for (int i = 0; i < restart_settings.size(); i++) {
+		unsolvable->randomization.seed = i + 1;
+		unsolvable->randomization.restarts = restart_settings[i].first;
+		unsolvable->randomization.restart_base = restart_settings[i].second.first;
+		unsolvable->randomization.restart_growth = restart_settings[i].second.second;
+		unsolvable->limits.deadline = chrono::steady_clock::now() + chrono::seconds(10);
+		if (!unsolvable->solve(board, 1).empty() || unsolvable->last_search().status != dlx_search_status::completed) {
+			failure = "restart setting " + to_string(i) + " ended as " + dlx_search_status_name(unsolvable->last_search().status) + " on a board with no solution";
+			return limit_cases.size() + 3 + i;
+		}
+	}
+	return limit_cases.size() + 2 + restart_settings.size();
+}
+
+// Returns the problems checkSolutionOutputs runs on: 9x9 sudokus from test_inputs and random ones with up to 1000
+// solutions, and n-queens boards from 1x1 to 8x8, empty and with a queen given, each paired with whether it is a
+// sudoku. num_sudokus is set to the number of sudokus, which come first.
+vector<pair<vector<vector<int> >, bool> > outputProblems(int& num_sudokus) {
+	vector<pair<vector<vector<int> >, bool> > problems;
+	unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > counter(new_dlx_matrix_sudoku(9));
+	counter->quiet = true;
+	counter->limits.max_attempts = 100000;
+	for (int i = 1; i < 5; i++) {
+		problems.push_back(make_pair(readBoard("test_inputs/" + to_string(i) + ".txt"), true));
+	}
+	for (int i = 1; problems.size() < 40; i++) {
+		vector<vector<int> > board = randomBoard(3, 60 + i % 15, i);
+		unsigned long long solutions = counter->count(board);
+		if (counter->last_search().status == dlx_search_status::completed && solutions <= 1000) {
+			problems.push_back(make_pair(board, true));
+		}
+	}
+	num_sudokus = problems.size();
+	for (int width = 1; width <= 8; width++) {
+		problems.push_back(make_pair(vector<vector<int> >(), false));
+		vector<vector<int> > given(width, vector<int>(width, 0));
+		given[width - 1][width / 2] = 1;
+		problems.push_back(make_pair(given, false));
+	}
+	return problems;
+}
+
+// Returns whether a board is complete: a sudoku with no empty cells, or an n-queens board with a queen on every row.
+bool isComplete(const vector<vector<int> >& board, bool is_sudoku) {
+	for (int row = 0; row < board.size(); row++) {
+		int filled = 0;
+		for (int col = 0; col < board[row].size(); col++) {
+			filled += is_sudoku ? board[row][col] != -1 : board[row][col] != 0;
+		}
+		if (filled != (is_sudoku ? board.size() : 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Solves 9x9 sudokus and n-queens boards with solve(board, -1) and checks the other ways of getting their solutions
+// against it, which must give the same solutions in the same order: enumerate, both as boards and decoded into a flat
+// buffer, solve_packed, both as boards and unpacked into a flat buffer, and the complete boards of the move traces
+// recorded with the correct_moves and all_moves save settings. for_each_solution must stop when its callback returns
+// false, and an iterator abandoned part way through must leave the next search unaffected.
+int checkSolutionOutputs(string& failure) {
+	int num_sudokus;
+	vector<pair<vector<vector<int> >, bool> > problems = outputProblems(num_sudokus);
+	for (int i = 0; i < problems.size(); i++) {
+		vector<vector<int> > board = problems[i].first;
+		bool is_sudoku = problems[i].second;
+		int width = is_sudoku ? 9 : (i - num_sudokus) / 2 + 1;
+		unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > solver(is_sudoku ? new_dlx_matrix_sudoku(9) : new dlx_matrix_n_queens(width));
+		solver->quiet = true;
+		vector<vector<vector<int> > > solutions = solver->solve(board, -1);
+		vector<vector<vector<int> > > iterated;
+		vector<vector<vector<int> > > decoded;
+		vector<vector<int> > next_board;
+		dlx_matrix<vector<vector<int> >, vector<vector<int> > >::solution_iterator boards = solver->enumerate(board);
+		while (boards.next(next_board)) {
+			iterated.push_back(next_board);
+		}
+		vector<int> cells(solver->solution_size());
+		dlx_matrix<vector<vector<int> >, vector<vector<int> > >::solution_iterator flat = solver->enumerate(board);
+		while (flat.next(&cells[0])) {
+			decoded.push_back(dlx_grid(&cells[0], width));
+		}
+		if (iterated != solutions || decoded != solutions) {
+			failure = "problem " + to_string(i) + " has different solutions from enumerate";
+			return i + 1;
+		}
+		// a search abandoned after its first solution is ended by the next one, which must not be affected by it
+		vector<vector<vector<int> > > streamed;
+		unsigned long long passed = solver->for_each_solution(board, [&streamed](const vector<vector<int> >& solution) {
+			streamed.push_back(solution);
+			return streamed.size() < 2;
+		});
+		dlx_matrix<vector<vector<int> >, vector<vector<int> > >::solution_iterator abandoned = solver->enumerate(board);
+		abandoned.next(next_board);
+		if (passed != min(solutions.size(), (size_t)2) || !equal(streamed.begin(), streamed.end(), solutions.begin()) || solver->solve(board, -1) != solutions) {
+			failure = "problem " + to_string(i) + " has different solutions after stopping a search early";
+			return i + 1;
+		}
+		dlx_matrix<vector<vector<int> >, vector<vector<int> > >::solution_store store = solver->solve_packed(board);
+		bool same = store.size() == solutions.size() && (store.size() == 0 || store.bytes_per_solution() == solver->packed_size());
+		for (int j = 0; j < store.size() && same; j++) {
+			store.get(j, &cells[0]);
+			same = store.board(j) == solutions[j] && dlx_grid(&cells[0], width) == solutions[j];
+		}
+		if (!same) {
+			failure = "problem " + to_string(i) + " has different solutions from solve_packed";
+			return i + 1;
+		}
+		dlx_matrix<vector<vector<int> >, vector<vector<int> > >::dlx_save_setting trace_settings[] = {dlx_matrix<vector<vector<int> >, vector<vector<int> > >::dlx_save_setting::correct_moves, dlx_matrix<vector<vector<int> >, vector<vector<int> > >::dlx_save_setting::all_moves};
+		for (int setting = 0; setting < 2; setting++) {
+			dlx_matrix<vector<vector<int> >, vector<vector<int> > >::move_trace moves = solver->trace(board, -1, trace_settings[setting]);
+			vector<vector<vector<int> > > traced;
+			for (int move = 0; move < moves.size(); move++) {
+				vector<vector<int> > move_board = moves.board(move);
+				if (isComplete(move_board, is_sudoku)) {
+					traced.push_back(move_board);
+				}
+			}
+			// a problem which its givens solve has no moves to trace
+			bool solved_by_givens = moves.size() == 0 && solutions.size() == 1;
+			if (traced != solutions && !solved_by_givens) {
+				failure = "problem " + to_string(i) + " has different solutions in its " + (setting == 0 ? "correct_moves" : "all_moves") + " trace";
+				return i + 1;
+			}
+		}
+	}
+	return problems.size();
+}
+
+// Counts the solutions of n-queens boards from 1x1 to 11x11, random 9x9 sudokus which count finishes within 200000
+// attempts and the pentomino tilings of the 3x20 rectangle with count_parallel on 1, 2, 3, 4 and 8 threads, each of
+// which must match count. They are also solved with solve_parallel, which must find the solutions of solve in the same
+// order, or with a limit of 3 solutions, 3 of them (or all of them if there are fewer).
+int checkParallel(string& failure) {
+	typedef dlx_matrix<vector<vector<int> >, vector<vector<int> > > solver;
+	vector<pair<function<solver*()>, vector<vector<int> > > > problems;
+	for (int width = 1; width <= 11; width++) {
+		problems.push_back(make_pair([width]() -> solver* {
+			return new dlx_matrix_n_queens(width);
+		}, vector<vector<int> >()));
+	}
+	unique_ptr<solver> counter(new_dlx_matrix_sudoku(9));
+	counter->quiet = true;
+	counter->limits.max_attempts = 200000;
+	for (int i = 1, sudokus = 0; sudokus < 10; i++) {
+		vector<vector<int> > board = randomBoard(3, 62 + i % 10, i);
+		counter->count(board);
+		if (counter->last_search().status == dlx_search_status::completed) {
+			problems.push_back(make_pair([]() -> solver* {
+				return new_dlx_matrix_sudoku(9);
+			}, board));
+			sudokus++;
+		}
+	}
+	problems.push_back(make_pair([]() -> solver* {
+		return new dlx_matrix_polyomino(pentominoes(), 20, 3);
+	}, rectangleBoard(20, 3)));
+	int thread_counts[] = {1, 2, 3, 4, 8};
+	for (int i = 0; i < problems.size(); i++) {
+		unique_ptr<solver> matrix(problems[i].first());
+		matrix->quiet = true;
+		unsigned long long expected = matrix->count(problems[i].second);
+		for (int j = 0; j < 5; j++) {
+			unsigned long long counted = matrix->count_parallel(problems[i].second, thread_counts[j]);
+			if (counted != expected) {
+				failure = "problem " + to_string(i) + " has " + to_string(counted) + " solutions on " + to_string(thread_counts[j]) + " threads and " + to_string(expected) + " on one";
+				return i + 1;
+			}
+		}
+		vector<vector<vector<int> > > solutions = matrix->solve(problems[i].second, -1);
+		for (int j = 0; j < 5; j++) {
+			bool same = matrix->solve_parallel(problems[i].second, -1, thread_counts[j]) == solutions;
+			vector<vector<vector<int> > > first = matrix->solve_parallel(problems[i].second, 3, thread_counts[j]);
+			same = same && first.size() == min(solutions.size(), (size_t)3);
+			for (int k = 0; k < first.size() && same; k++) {
+				same = find(solutions.begin(), solutions.end(), first[k]) != solutions.end();
+			}
+			if (!same) {
+				failure = "problem " + to_string(i) + " has different solutions from solve_parallel on " + to_string(thread_counts[j]) + " threads";
+				return i + 1;
+			}
+		}
+	}
+	return problems.size();
+}
+
+vector<check_case> checkCases() {
+	vector<check_case> cases;
+	cases.push_back({"check reuse sudoku 9x9", [](string& failure) {
+		return checkReuse([]() {
+			return new_dlx_matrix_sudoku(9);
+		}, 3, 2000, failure);
+	}});
+	cases.push_back({"check reuse sudoku 9x9 runtime", [](string& failure) {
+		return checkReuse([]() {
+			return new dlx_matrix_sudoku(9);
+		}, 3, 2000, failure);
+	}});
+	cases.push_back({"check reuse sudoku 16x16", [](string& failure) {
+		return checkReuse([]() {
+			return new_dlx_matrix_sudoku(16);
+		}, 4, 200, failure);
+	}});
+	cases.push_back({"check parallel", checkParallel});
+	cases.push_back({"check batch mixed sizes", checkBatch});
+	cases.push_back({"check solution outputs", checkSolutionOutputs});
+	cases.push_back({"check limits", checkLimits});
+	cases.push_back({"check static sudoku 4x4", [](string& failure) {
+		return checkStatic<4>(2, 500, failure);
+	}});
+	cases.push_back({"check static sudoku 9x9", [](string& failure) {
+		return checkStatic<9>(3, 2000, failure);
+	}});
+	cases.push_back({"check static sudoku 16x16", [](string& failure) {
+		return checkStatic<16>(4, 200, failure);
+	}});
+	cases.push_back({"check bitboard sudoku 1x1", [](string& failure) {
+		return checkBitboard(1, 20, failure);
+	}});
+	cases.push_back({"check bitboard sudoku 4x4", [](string& failure) {
+		return checkBitboard(2, 500, failure);
+	}});
+	cases.push_back({"check bitboard sudoku 9x9", [](string& failure) {
+		return checkBitboard(3, 2000, failure);
+	}});
+	cases.push_back({"check bitboard sudoku 16x16", [](string& failure) {
+		return checkBitboard(4, 200, failure);
+	}});
+	cases.push_back({"check generator 4x4", [](string& failure) {
+		return checkGenerator(4, 200, failure);
+	}});
+	cases.push_back({"check generator 9x9", [](string& failure) {
+		return checkGenerator(9, 40, failure);
+	}});
+	cases.push_back({"check n-queens distinct", checkQueensDistinct});
+	cases.push_back({"check pentominoes", checkPentominoes});
+	cases.push_back({"check copies", checkCopies});
+	cases.push_back({"check pruning", checkPruning});
+	cases.push_back({"check colors", [](string& failure) {
+		return checkColors(3000, failure);
+	}});
+	return cases;
+}
+
+int main(int argc, char* argv[]) {
+	int repeats = 3;
+	string filter = "";
+	if (argc > 1) {
+		repeats = max(atoi(argv[1]), 1);
+	}
+	if (argc > 2) {
+		filter = argv[2];
+	}
+	vector<bench_case> cases = benchCases();
+	bool printed_header = false;
+	for (int i = 0; i < cases.size(); i++) {
+		if (cases[i].name.find(filter) == string::npos) {
+			continue;
+		}
+		if (!printed_header) {
+			printf("%-26s %10s %10s %10s %10s %10s %8s %12s %10s %10s\n", "case", "solutions", "min ms", "median ms", "mean ms", "stddev ms", "runs", "nodes/s", "matrix KB", "peak KB");
+			printed_header = true;
+		}
+		unique_ptr<dlx_matrix<vector<vector<int> >, vector<vector<int> > > > matrix(cases[i].make_solver());
+		vector<double> times;
+		vector<double> node_rates;
+		unsigned long long solutions = 0;
+		for (int run = 0; run < repeats; run++) {
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			solutions = cases[i].run(*matrix);
+			times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+			const dlx_search_stats& stats = matrix->last_search();
+			if (stats.search_us > 0) {
+				node_rates.push_back(stats.attempts / (stats.search_us / 1e6));
+			}
+		}
+		vector<double> sorted_times = times;
+		sort(sorted_times.begin(), sorted_times.end());
+		double median = (sorted_times[(repeats - 1) / 2] + sorted_times[repeats / 2]) / 2;
+		double mean = 0;
+		for (int run = 0; run < repeats; run++) {
+			mean += times[run] / repeats;
+		}
+		double variance = 0;
+		for (int run = 0; run < repeats; run++) {
+			variance += (times[run] - mean) * (times[run] - mean) / max(repeats - 1, 1);
+		}
+		sort(node_rates.begin(), node_rates.end());
+		double node_rate = node_rates.empty() ? 0 : node_rates[node_rates.size() / 2];
+		printf("%-26s %10llu %10.3f %10.3f %10.3f %10.3f %8d %12.0f %10zu %10ld\n", cases[i].name.c_str(), solutions, sorted_times[0], median, mean, sqrt(variance), repeats, node_rate, matrix->matrix_memory() / 1024, peakMemoryKB());
+		fflush(stdout);
+	}
+	vector<pair<string, int> > tail_sizes = {{"16x16", 4}, {"25x25", 5}};
+	vector<int> tail_empty_percents = {70, 65};
+	vector<int> tail_counts = {200, 40};
+	printed_header = false;
+	for (int i = 0; i < tail_sizes.size(); i++) {
+		for (int randomized = 0; randomized < 2; randomized++) {
+			string name = "sudoku " + tail_sizes[i].first + " tail " + (randomized ? "luby restarts" : "fixed order");
+			if (name.find(filter) == string::npos) {
+				continue;
+			}
+			if (!printed_header) {
+				printf("\n%-34s %8s %10s %10s %10s %10s %8s %10s\n", "case", "puzzles", "p50 ms", "p90 ms", "p99 ms", "max ms", "stopped", "restarts");
+				printed_header = true;
+			}
+			runTailCase(name, tail_sizes[i].second, tail_empty_percents[i], tail_counts[i], randomized, 2000000);
+		}
+	}
+	vector<pair<int, int> > generator_cases = {{9, 500}, {16, 5}};
+	printed_header = false;
+	for (int i = 0; i < generator_cases.size(); i++) {
+		string size = to_string(generator_cases[i].first);
+		string name = "generate " + size + "x" + size + " minimal";
+		if (name.find(filter) == string::npos) {
+			continue;
+		}
+		if (!printed_header) {
+			printf("\n%-34s %8s %8s %12s %10s\n", "case", "puzzles", "threads", "puzzles/s", "clues");
+			printed_header = true;
+		}
+		runGeneratorCase(name, generator_cases[i].first, generator_cases[i].second);
+	}
+	vector<pair<string, int> > polyomino_sets = {{"pentominoes", 5}, {"hexominoes", 6}, {"heptominoes", 7}};
+	printed_header = false;
+	for (int i = 0; i < polyomino_sets.size(); i++) {
+		string name = "matrix " + polyomino_sets[i].first;
+		if (name.find(filter) == string::npos) {
+			continue;
+		}
+		if (!printed_header) {
+			printf("\n%-34s %8s %8s %8s %10s %10s %10s\n", "case", "pieces", "orients", "side", "shapes ms", "matrix ms", "matrix KB");
+			printed_header = true;
+		}
+		runPolyominoGenerationCase(name, polyomino_sets[i].second, repeats);
+	}
+	string color_name = "prime squares 3x3 colors";
+	if (color_name.find(filter) != string::npos) {
+		printf("\n%-26s %10s %10s %10s %8s %12s %10s %10s\n", "case", "solutions", "min ms", "median ms", "runs", "nodes/s", "matrix KB", "peak KB");
+		runColorCase(color_name, 3, repeats);
+	}
+	string scaling_name = "n-queens 13 parallel";
+	if (scaling_name.find(filter) != string::npos) {
+		printf("\n%-26s %8s %10s %10s %8s\n", "case", "threads", "solutions", "min ms", "speedup");
+		runScalingCase(scaling_name, 13, repeats);
+	}
+	vector<check_case> checks = checkCases();
+	int failed = 0;
+	printed_header = false;
+	for (int i = 0; i < checks.size(); i++) {
+		if (checks[i].name.find(filter) == string::npos) {
+			continue;
+		}
+		if (!printed_header) {
+			printf("\n%-34s %8s %10s   %s\n", "case", "problems", "ms", "result");
+			printed_header = true;
+		}
+		string failure;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		int checked = checks[i].run(failure);
+		double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		printf("%-34s %8d %10.1f   %s\n", checks[i].name.c_str(), checked, ms, failure.empty() ? "ok" : failure.c_str());
+		fflush(stdout);
+		failed += !failure.empty();
+	}
+	return (failed > 0) ? 1 : 0;
+}
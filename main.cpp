@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <regex>
 #include "DLX.h"
+#include "SudokuSolver.h"
 #include "JGraph.h"
 #include <fstream>
 #include <sstream>
@@ -161,15 +162,16 @@ public:
 	// in and out: istream and ostream references; they will probably normally be cin and cout
 	// target_puzzle: a sudoku as vector<vector<int> >; sides must be the same and squares
 	// output_file: name of the output .jpg file
-	void interactiveSolver(istream& in, ostream& out, vector<vector<int> > target_puzzle, string output_file) {
-		dlx_matrix_sudoku solution_matrix(target_puzzle.size());
+	// solver: the backend used to solve target_puzzle
+	void interactiveSolver(istream& in, ostream& out, vector<vector<int> > target_puzzle, string output_file, sudoku_solver& solver) {
 		vector<vector<int> > user_board = target_puzzle;
-		vector<vector<vector<int> > > solutions = solution_matrix.solve(target_puzzle, 1);
-		if (solutions.size() < 1) {
+		vector<vector<vector<int> > > solutions(1);
+		dlx_uniqueness uniqueness = solver.verify_unique(target_puzzle, &solutions[0]);
+		if (uniqueness == dlx_uniqueness::none) {
 			out << "Puzzle is unsolvable.\n";
 			return;
 		}
-		else if (solutions.size() > 1) {
+		else if (uniqueness == dlx_uniqueness::multiple) {
 			out << "Puzzle has more than one solution.\n";
 			return;
 		}
@@ -332,9 +334,22 @@ vector<vector<int> > getBoardFromStream(istream& in) {
 int main(int argc, char* argv[]) {
 
 	string progName = string(argv[0]);
-	vector<string> args(argc-1);
-	for (int i = 0; i < args.size(); i++) {
-		args[i] = string(argv[i + 1]);
+	vector<string> args;
+	string backend = "dlx";
+	for (int i = 1; i < argc; i++) {
+		string arg = string(argv[i]);
+		if (arg.compare(0, 9, "--solver=") == 0) {
+			backend = arg.substr(9);
+		}
+		else {
+			args.push_back(arg);
+		}
+	}
+
+	unique_ptr<sudoku_solver> solver(new_sudoku_solver(backend));
+	if (!solver) {
+		cout << "Error: Unknown solver " << backend << ", must be dlx or bitboard.\n";
+		return 0;
 	}
 
 	vector<vector<int> > target_puzzle;
@@ -352,7 +367,7 @@ int main(int argc, char* argv[]) {
 		target_puzzle = getBoardFromStream(cin);
 	}
 	else if(args.size() > 2) {
-		cout << progName << " arguments are optional, first must be the name of a textfile containing a valid sudoku board, second must be the name of the output file.\n";
+		cout << progName << " arguments are optional, first must be the name of a textfile containing a valid sudoku board, second must be the name of the output file. The solver may be chosen with --solver=dlx or --solver=bitboard.\n";
 		return 0;
 	}
 
@@ -366,8 +381,13 @@ int main(int argc, char* argv[]) {
 		file_name = args[1];
 	}
 
+	if (solver->name() == "bitboard" && target_puzzle.size() > bitboard_sudoku_solver::max_width) {
+		cout << "The bitboard solver supports boards up to " << bitboard_sudoku_solver::max_width << " wide, using dlx instead.\n";
+		solver.reset(new_sudoku_solver("dlx"));
+	}
+
 	SudokuVisualizer visualizer;
-	visualizer.interactiveSolver(cin, cout, target_puzzle, file_name);
+	visualizer.interactiveSolver(cin, cout, target_puzzle, file_name, *solver);
 
 	return 0;
 }
\ No newline at end of file